@@ -79,6 +79,7 @@ class AppUI {
   void (*idleCallback)();
   uint32_t idleTimeout;
   uint32_t idleStart;
+  void (*pollCallback)();
   iconstate_t btIcon;
   iconstate_t sdIcon;
 
@@ -116,6 +117,7 @@ class AppUI {
   void setSDcardStatus(bool mounted);
   void setBluetoothStatus(bool active);
   void setIdleCallback(void (*callback)(), uint32_t timeout);
+  void setPollCallback(void (*callback)());
   btnid_t promptCustom(navmenu_t* nav);
   btnid_t promptOk();
   btnid_t promptOkCancel();
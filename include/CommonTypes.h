@@ -1,5 +1,7 @@
 #pragma once
 
+#define EARTH_RADIUS 6371000.0f  // mean radius of the earth (unit: meter)
+
 typedef enum _fmtreg {
   FMT_TIME = 0x00000001,    // type: uint32
   FMT_VALID = 0x00000002,   // type: uint16
@@ -4,27 +4,54 @@
 #include <stdlib.h>
 
 #include "CommonTypes.h"
+#include "GzipFileWriter.h"
 
 #define PARSER_DESCR "SmallStep/M5Stack v20250829"
 #define MAX_WAYPTS_PER_TRK 250
 
+typedef struct _gpxstats {
+  double distance;      // travelled distance (unit: meter)
+  uint32_t movingTime;  // time moved faster than MOVING_SPEED (unit: sec)
+  float maxSpeed;       // (unit: m/s)
+  float eleGain;        // total elevation gain (unit: meter)
+  float eleLoss;        // total elevation loss (unit: meter)
+  double minLat;        // bounding box (unit: degree)
+  double minLon;        //
+  double maxLat;        //
+  double maxLon;        //
+  int32_t posCount;     // a number of trkpts with the position (the bounding box is valid if not zero)
+} gpxstats_t;
+
 typedef struct _gpxinfo {
   uint32_t startTime;
   uint32_t endTime;
   int32_t trkptCount;  //
   int32_t trackCount;  //
   int32_t wayptCount;  // a number of waypts
+  gpxstats_t stats;    // statistics of the trkpts
 } gpxinfo_t;
 
 class GpxFileWriter {
  private:
+  const float MOVING_SPEED = 0.5;   // min. speed to be regarded as moving (unit: m/s)
+  const float ELE_THRESHOLD = 3.0;  // min. elevation change to be counted (unit: meter)
+
   File32 *out;
+  File32 *statsOut;
+  GzipFileWriter *gzout;
 
   gpxinfo_t gpxInfo;
   gpxinfo_t trackInfo;
+  gpxinfo_t totalInfo;
   gpsrecord_t waypts[MAX_WAYPTS_PER_TRK];
+  gpsrecord_t lastTrkpt;
+  float refEle;
+  uint16_t statsCount;
 
   int32_t offsetSec;
+  uint32_t sizeHint;
+  bool preAllocated;
+  void (*rolloverCallback)(File32 *, File32 *, gpxinfo_t);
   bool inGpx;
   bool inTrack;
   bool inTrkSeg;
@@ -32,23 +59,33 @@ class GpxFileWriter {
   void beginGpx();
   void beginTrack();
   void beginTrackSeg();
+  void closeTrack();
   void putWaypt(gpsrecord_t rcd);
   void putTrackPoint(gpsrecord_t rcd, bool asWpt);
   void putLatLon(gpsrecord_t rcd);
   void putHeight(gpsrecord_t rcd);
   void putSpeed(gpsrecord_t rcd);
   void putTime(gpsrecord_t rcd);
+  void putStats(gpxinfo_t *info);
+  void updateStats(gpsrecord_t rcd);
+  void write(const char *str);
+  static void mergeStats(gpxinfo_t *dst, const gpxinfo_t *src);
+  float distance(double lat1, double lon1, double lat2, double lon2);
 
  public:
-  GpxFileWriter(File32 *output);
+  GpxFileWriter(File32 *output, bool compress);
   ~GpxFileWriter();
 
   int16_t addWaypt(gpsrecord_t rcd);
   void endTrack();
   void endTrackSeg();
   gpxinfo_t endGpx();
+  void estimateSize(uint32_t inputSize, uint16_t recordSize, uint32_t format);
   uint32_t getLastTime();
+  gpxinfo_t getTotalInfo();
   void putTrkpt(gpsrecord_t rcd);
+  void setRolloverCallback(void (*callback)(File32 *, File32 *, gpxinfo_t));
+  void setStatsOutput(File32 *output);
   void setTimeOffset(float tz);
   char *timeToString(char *buf, uint32_t gpsTime);
   char *timeToISO8601(char *buf, uint32_t gpsTime);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <SdFat.h>
+#include <stdlib.h>
+
+class GzipFileWriter {
+ private:
+  static const uint16_t WINDOW_SIZE = 4096;  // LZ77 window (must be a power of 2, <= 32768)
+  static const uint16_t WINDOW_MASK = (WINDOW_SIZE - 1);
+  static const uint8_t HASH_BITS = 11;
+  static const uint16_t HASH_SIZE = (1 << HASH_BITS);
+  static const uint16_t HASH_NIL = 0xFFFF;
+  static const uint16_t MIN_MATCH = 3;
+  static const uint16_t MAX_MATCH = 258;
+  static const uint8_t MAX_CHAIN = 32;
+  static const uint16_t OUT_SIZE = 512;  // = SD card block size
+
+  /*
+   * Note:
+   * The compressor uses the fixed Huffman codes of deflate (RFC1951, BTYPE=01) and a small LZ77 window
+   * to keep the memory usage within about 21 KB of heap. GPX text is highly repetitive, so the output
+   * is still around 1/6 to 1/10 of the original size.
+   */
+
+  File32 *out;
+  uint8_t window[WINDOW_SIZE * 2];
+  uint16_t head[HASH_SIZE];
+  uint16_t prev[WINDOW_SIZE];
+  uint16_t litCodes[288];
+  uint8_t outBuf[OUT_SIZE];
+  uint16_t outLen;
+  uint32_t bitBuf;
+  uint8_t bitCount;
+  uint16_t strStart;
+  uint16_t lookEnd;
+  uint32_t crc;
+  uint32_t inSize;
+  bool inStream;
+
+  static uint16_t reverseBits(uint16_t code, uint8_t len);
+  static uint16_t hash(const uint8_t *p);
+  void compressWindow(bool flush);
+  void insertString(uint16_t pos);
+  uint16_t findMatch(uint16_t pos, uint16_t *dist);
+  void putBits(uint32_t value, uint8_t len);
+  void putByte(uint8_t by);
+  void putLiteral(uint16_t sym);
+  void putMatch(uint16_t len, uint16_t dist);
+  void flushBits();
+  void flushOutput();
+  void slideWindow();
+  void updateCrc(const uint8_t *data, size_t len);
+
+ public:
+  GzipFileWriter(File32 *output);
+
+  void begin();
+  void end();
+  uint32_t inputSize();
+  size_t write(const char *str);
+  size_t write(const uint8_t *data, size_t len);
+};
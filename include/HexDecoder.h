@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HEX_INVALID 0xFF  // value of the characters that are not hexadecimal digits
+
+/*
+ * Note:
+ * The decoder has no dependency on Arduino, so the same code can be built for the host-side tools.
+ */
+
+class HexDecoder {
+ private:
+  static const uint8_t VALUES[256];
+
+ public:
+  // convert a hexadecimal character to its value (0-15, or HEX_INVALID)
+  static inline uint8_t value(char ch) {
+    return VALUES[(uint8_t)ch];
+  }
+
+  static size_t decode(const char *src, size_t len, uint8_t *dst);
+  static uint8_t checksum(const char *src, size_t len);
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "HexDecoder.h"
+
+#define DD_BLOCK_SIZE 0x800  // max size of the data in a reply (= SIZE_REPLY)
+
+typedef enum _decodestate {
+  DS_IDLE = 0,     // waiting for '$'
+  DS_HEADER = 1,   // matching the "PMTK182,8," prefix
+  DS_ADDRESS = 2,  // decoding the address column
+  DS_DATA = 3,     // decoding the data column
+  DS_CHECKSUM = 4  // decoding the checksum after '*'
+} decodestate_t;
+
+class MtkDataDecoder {
+ private:
+  static const char *HEADER;
+
+  /*
+   * Note:
+   * A data reply "$PMTK182,8,ADDR,DATA*CS" carries up to 0x800 bytes of the log data as 4 KB of hex text.
+   * The decoder consumes the reply a character at a time as it arrives and decodes the data column directly into the
+   * binary block, calculating the NMEA checksum on the fly. The block is committed only when the checksum matches.
+   */
+
+  uint8_t block[DD_BLOCK_SIZE];
+  decodestate_t state;
+  uint8_t headerPos;
+  uint32_t address;
+  uint16_t length;
+  uint8_t highNibble;
+  bool hasHighNibble;
+  uint8_t calcChecksum;
+  uint8_t recvChecksum;
+  uint8_t checksumDigits;
+  uint32_t errors;
+
+  void begin();
+  void abandon();
+
+ public:
+  MtkDataDecoder();
+
+  void clear();
+  bool put(char ch);
+  bool put(const char *chars, uint16_t len, uint16_t *used);
+  uint32_t getAddress();
+  const uint8_t *getData();
+  uint16_t getLength();
+  uint32_t getErrors();
+};
@@ -5,7 +5,10 @@
 #include <MtkParser.h>
 #include <SdFat.h>
 
+#include "MtkDataDecoder.h"
 #include "NmeaBuffer.h"
+#include "NmeaClassifier.h"
+#include "RxRingBuffer.h"
 
 typedef enum _sizeinfo {
   SIZE_REPLY = 0x000800,
@@ -26,28 +29,163 @@ typedef struct _logcriteria {
   int16_t speed;
 } logcriteria_t;
 
+typedef struct _linkstats {
+  int32_t reqSize;     // current size of a download request (bytes)
+  uint16_t timeout1;   // current timeout for the first reply of a request (msec)
+  uint16_t timeout2;   // current timeout for the following replies (msec)
+  uint32_t latency;    // smoothed latency from a request to its first reply (msec; 0 = not measured)
+  uint32_t gapAvg;     // smoothed gap between the replies (msec; 0 = not measured)
+  uint32_t gapDev;     // smoothed mean deviation of the gap (msec)
+  uint32_t blocks;     // number of the blocks received
+  uint32_t retries;    // number of the failures (timeouts and lost blocks)
+  int32_t cleanSize;   // size received since the last failure (bytes)
+} linkstats_t;
+
+#define DL_HIST_BUCKETS 8  // number of the buckets of the latency / gap histograms
+
+typedef struct _dlstats {
+  uint32_t elapsed;                       // time of the download (msec)
+  uint32_t bytes;                         // bytes of the log data received
+  uint32_t requests;                      // download requests sent (including the requests sent again)
+  uint32_t blocks;                        // blocks accepted
+  uint32_t timeouts;                      // waits for a reply timed out
+  uint32_t resent;                        // blocks requested again because they were lost
+  uint32_t outOfOrder;                    // blocks accepted out of order
+  uint32_t dropped;                       // replies ignored (duplicated or out of the window)
+  uint32_t broken;                        // replies truncated or with a checksum error
+  uint32_t rateAvg;                       // throughput over the whole download (bytes/sec)
+  uint32_t rateNow;                       // throughput over the last window (bytes/sec)
+  uint32_t rateMin;                       // the lowest throughput of the windows (bytes/sec)
+  uint32_t rateMax;                       // the highest throughput of the windows (bytes/sec)
+  uint32_t latencyMin;                    // the shortest latency from a request to its first reply (msec)
+  uint32_t latencyMax;                    // the longest latency from a request to its first reply (msec)
+  uint16_t latencyHist[DL_HIST_BUCKETS];  // latencies (< 50, 100, 200, 500, 1000, 2000, 5000, >= 5000 msec)
+  uint16_t gapHist[DL_HIST_BUCKETS];      // gaps between the replies (< 5, 10, 20, 50, 100, 200, 500, >= 500 msec)
+  uint32_t rxHighWater;                   // the highest fill level of the rx ring buffer (bytes)
+  uint32_t rxOverflow;                    // bytes dropped because the rx ring buffer was full
+} dlstats_t;
+
+typedef enum _capturedir {
+  CAPTURE_RX = 0,  // received from the logger
+  CAPTURE_TX = 1   // sent to the logger
+} capturedir_t;
+
+typedef struct _capturerecord {
+  uint32_t time;    // time since the capture is started (msec)
+  uint16_t length;  // length of the data following this header
+  uint8_t dir;      // capturedir_t
+  uint8_t reserved;
+} capturerecord_t;
+
+typedef struct _cacheindexhdr {
+  char magic[4];         // CACHE_INDEX_MAGIC
+  uint32_t sectorSize;   // must be SIZE_SECTOR
+  uint32_t sectorCount;  // number of the entries (must be MAX_SECTORS)
+} cacheindexhdr_t;
+
+typedef struct _cacheindexent {
+  uint32_t headHash;    // FNV-1a hash of the first block (0x800 bytes) of the sector
+  uint32_t sectorHash;  // FNV-1a hash of the hashes of the blocks of the sector (both 0: not cached)
+} cacheindexent_t;
+
+typedef struct _nmeaquery {
+  const char *command;                              // command to send (without the leading '$' and the checksum)
+  const char *reply;                                // prefix of the expected reply
+  void (*handler)(NmeaBuffer *reply, void *param);  // function called with the reply (or NULL)
+  void *param;                                      // parameter passed to the handler
+} nmeaquery_t;
+
 class MtkLogger {
  private:
+  static const uint16_t RX_CHUNK_SIZE = 1024;
+  static const uint32_t DEFAULT_RX_RING_SIZE = 8192;
+
+  static const uint16_t MAX_SECTORS = (SIZE_32MBIT / SIZE_SECTOR);
+  static const uint32_t FNV_INIT = 2166136261UL;
+  static const uint8_t MAX_BATCH_SIZE = 32;
+
+  const char *CACHE_INDEX_MAGIC = "SSX2";
+  const char *CAPTURE_MAGIC = "SSCAPTR1";
   const uint32_t MSG_TIMEOUT = 1000;
   const int32_t ACK_TIMEOUT = 100;
+  const uint8_t DEFAULT_REQ_WINDOW = 2;
+  const uint8_t MAX_REQ_WINDOW = 4;
+  const int32_t MIN_REQ_SIZE = SIZE_REPLY;
+  const int32_t MAX_REQ_SIZE = 0x8000;
+  const int32_t MAX_WINDOW_SIZE = 64 * SIZE_REPLY;  // the blocks tracked by the bitmaps of downloadRange()
+  const uint16_t MIN_TIMEOUT1 = 1000;
+  const uint16_t MAX_TIMEOUT1 = 3000;
+  const uint16_t MIN_TIMEOUT2 = 250;
+  const uint16_t MAX_TIMEOUT2 = 1000;
+  const uint32_t RATE_WINDOW = 2000;
+  const uint16_t LATENCY_LIMITS[DL_HIST_BUCKETS - 1] = {50, 100, 200, 500, 1000, 2000, 5000};
+  const uint16_t GAP_LIMITS[DL_HIST_BUCKETS - 1] = {5, 10, 20, 50, 100, 200, 500};
 
   const char *deviceName;
   char address[6];
   bool sppStarted;
+  uint8_t reqWindow;
+  linkstats_t linkStats;
+  dlstats_t dlStats;
+  uint32_t dlStartAt;
+  uint32_t rateWindowAt;
+  uint32_t rateWindowBytes;
+  uint32_t decoderErrors;
   BluetoothSerial *gpsSerial;
   NmeaBuffer *buffer;
+  MtkDataDecoder *decoder;
   esp_spp_cb_t eventCallback;
+  void (*replyHandlers[NMEA_TYPES])(NmeaBuffer *);
+  uint8_t rxBuf[RX_CHUNK_SIZE];
+  uint16_t rxPos;
+  uint16_t rxLen;
+  File32 *captureFile;
+  uint32_t captureStartAt;
+  RxRingBuffer *rxRing;
+
+  static TaskHandle_t rxWaiter;
+  static MtkLogger *rxOwner;
+  static esp_spp_cb_t appCallback;
 
   uint8_t calcNmeaChecksum(const char *cmd);
-  int32_t resetCache(File32 *cache);
+  bool probeSectors(int32_t endAddr, uint64_t *written, uint64_t *opened, uint32_t *headHashes);
+  void fillData(File32 *output, int32_t addr, int32_t endAddr);
+  bool copyData(File32 *src, int32_t srcPos, File32 *dst, int32_t dstPos, int32_t size);
+  bool hashCacheBlock(File32 *cache, int32_t addr, uint32_t *hash);
+  uint64_t verifyCache(File32 *cache, File32 *index, int32_t endAddr, const uint32_t *headHashes);
+  void initCacheIndex(File32 *index);
+  void writeCacheIndex(File32 *index, uint16_t sector, uint32_t headHash, uint32_t sectorHash);
+  bool downloadRange(File32 *output, File32 *index, int32_t startAddr, int32_t *endAddr, int32_t baseAddr,
+                     int32_t totalSize, void (*progressCallback)(int32_t, int32_t), bool *dataEnd);
+  bool requestMissingBlocks(int32_t nextAddr, int32_t reqAddr, uint64_t skip, uint64_t *resent);
+  static uint32_t fnv1a(uint32_t hash, const uint8_t *data, size_t len);
   bool sendNmeaCommand(const char *cmd);
   bool waitForNmeaReply(const char *reply, uint16_t timeout);
+  bool waitForDataReply(uint16_t timeout);
+  void dispatchReply();
+  static void readDecValue(NmeaBuffer *reply, void *value);
+  bool receive(uint32_t timeout);
+  void capture(capturedir_t dir, const void *data, uint16_t len);
+  static void sppCallback(esp_spp_cb_event_t event, esp_spp_cb_param_t *param);
+  static void sppDataCallback(const uint8_t *data, size_t len);
   bool sendDownloadCommand(int startPos, int reqSize);
   static int32_t firmwareIdToFlashSize(uint16_t modelId);
+  static bool matchName(const char *name, const char *pattern);
+  static uint16_t scanDataEnd(const uint8_t *data, uint16_t len, bool *dataEnd);
   bool getLastRecordAddress(int32_t *size);
+  bool getDownloadEnd(int32_t reqSize, int32_t *endAddr);
+  void resetLinkStats(int32_t reqSize);
+  void updateLinkLatency(uint32_t latency);
+  void updateLinkGap(uint32_t gap);
+  void adaptLink(bool failed);
+  void resetDownloadStats();
+  void updateDownloadRate(uint32_t bytes);
+  void finishDownloadStats();
+  void printDownloadSummary();
+  static uint8_t histBucket(uint32_t value, const uint16_t *limits);
 
  public:
-  MtkLogger(const char *devname);
+  MtkLogger(const char *devname, uint32_t rxRingSize = DEFAULT_RX_RING_SIZE);
   ~MtkLogger();
 
   bool clearFlash(void (*rateCallback)(int32_t, int32_t));
@@ -55,7 +193,10 @@ class MtkLogger {
   bool connect(uint8_t *address);
   bool connected();
   void disconnect();
-  bool downloadLogData(File32 *output, void (*rateCallback)(int32_t, int32_t));
+  int8_t discover(const char **patterns, uint8_t count, uint8_t *addr, char *name, size_t nameLen, uint32_t timeout);
+  bool downloadLogData(File32 *output, void (*rateCallback)(int32_t, int32_t), File32 *index = NULL);
+  bool downloadLatestData(File32 *cache, File32 *output, void (*progressCallback)(int32_t, int32_t),
+                          File32 *index = NULL);
   bool fixRTCdatetime();
   bool getFlashSize(int32_t *size);
   bool getLogByDistance(int16_t *dist);
@@ -64,12 +205,22 @@ class MtkLogger {
   bool getLogCriteria(logcriteria_t *criteria);
   bool getLogFormat(uint32_t *format);
   bool getLogRecordMode(recordmode_t *recmode);
+  linkstats_t getLinkStats();
+  dlstats_t getDownloadStats();
+  uint32_t getRxHighWater();
+  uint32_t getRxOverflow();
+  bool keepAlive();
   bool reloadDevice();
+  bool sendNmeaBatch(nmeaquery_t *queries, uint8_t count, uint16_t timeout);
   bool setLogByDistance(int16_t distance);
   bool setLogBySpeed(int16_t speed);
   bool setLogByTime(int16_t time);
   bool setLogCriteria(logcriteria_t criteria);
   bool setLogFormat(uint32_t format);
+  bool setLogMode(recordmode_t recmode, logcriteria_t criteria);
   bool setLogRecordMode(recordmode_t recmode);
+  void setCaptureFile(File32 *capture);
+  void setDownloadWindow(uint8_t window);
   void setEventCallback(esp_spp_cb_t evtCallback);
+  void setReplyHandler(nmeatype_t type, void (*handler)(NmeaBuffer *));
 };
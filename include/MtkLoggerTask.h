@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SdFat.h>
+
+#include "MtkLogger.h"
+
+typedef enum _loggerjobtype {
+  JOB_CONNECT = 0,          // connect to the logger (address)
+  JOB_DISCONNECT = 1,       // disconnect from the logger
+  JOB_DOWNLOAD = 2,         // download the log data (output, index, progressCallback)
+  JOB_CLEAR_FLASH = 3,      // clear the log data (progressCallback)
+  JOB_RELOAD = 4,           // reload the logger
+  JOB_FIX_RTC = 5,          // fix the RTC date/time of the logger
+  JOB_GET_LOG_FORMAT = 6,   // get the log format (-> format)
+  JOB_SET_LOG_FORMAT = 7,   // set the log format (format)
+  JOB_GET_LOG_MODE = 8,     // get the record mode and the log criteria (-> recordMode, criteria)
+  JOB_SET_LOG_MODE = 9,     // set the record mode and the log criteria (recordMode, criteria)
+  JOB_DOWNLOAD_LATEST = 10,  // download the newest sector only (cache, output, index, progressCallback)
+  JOB_KEEPALIVE = 11         // check if the logger answers on the current link
+} loggerjobtype_t;
+
+typedef struct _loggerjob {
+  uint32_t id;  // sequence number of the job (set when queued; never 0)
+  loggerjobtype_t type;
+  uint8_t address[6];
+  File32 *output;
+  File32 *index;
+  File32 *cache;
+  uint32_t format;
+  recordmode_t recordMode;
+  logcriteria_t criteria;
+  bool result;                                                    // result of the job (set when completed)
+  void (*progressCallback)(int32_t, int32_t);                     // called on the logger task
+  void (*completeCallback)(struct _loggerjob *job, void *param);  // called on the logger task (or NULL)
+  void *param;                                                    // parameter passed to completeCallback
+} loggerjob_t;
+
+class MtkLoggerTask {
+ private:
+  static const uint8_t QUEUE_LENGTH = 4;
+  static const uint32_t STACK_SIZE = 8192;
+
+  /*
+   * Note:
+   * The jobs are run one by one on a dedicated task, so the application task can update the UI or do other work while
+   * the logger task waits for the replies. A completed job is passed to its completeCallback, or posted to the
+   * completion queue if no callback is given. Do not call the MtkLogger methods directly while a job is running.
+   * The jobs are queued with a sequence number, and waitForCompletion() takes the completion of the given job only
+   * (the completions nobody waited for are discarded). Queue the jobs from a single task.
+   */
+
+  MtkLogger *logger;
+  QueueHandle_t jobQueue;
+  QueueHandle_t doneQueue;
+  TaskHandle_t task;
+  volatile bool running;
+  uint32_t lastId;
+
+  static void taskMain(void *arg);
+  void runJob(loggerjob_t *job);
+
+ public:
+  MtkLoggerTask(MtkLogger *lgr);
+
+  bool begin(UBaseType_t priority = 1, BaseType_t core = 1);
+  uint32_t submit(loggerjob_t *job);
+  bool waitForCompletion(uint32_t id, loggerjob_t *job, uint32_t timeout);
+  bool busy();
+  bool connected();
+
+  uint32_t connect(uint8_t *addr, void (*cb)(loggerjob_t *, void *) = NULL, void *param = NULL);
+  uint32_t disconnect(void (*cb)(loggerjob_t *, void *) = NULL, void *param = NULL);
+  uint32_t keepAlive(void (*cb)(loggerjob_t *, void *) = NULL, void *param = NULL);
+  uint32_t downloadLogData(File32 *output, void (*progressCallback)(int32_t, int32_t), File32 *index = NULL,
+                           void (*cb)(loggerjob_t *, void *) = NULL, void *param = NULL);
+  uint32_t downloadLatestData(File32 *cache, File32 *output, void (*progressCallback)(int32_t, int32_t),
+                              File32 *index = NULL, void (*cb)(loggerjob_t *, void *) = NULL, void *param = NULL);
+  uint32_t clearFlash(void (*progressCallback)(int32_t, int32_t), void (*cb)(loggerjob_t *, void *) = NULL,
+                      void *param = NULL);
+  uint32_t reloadDevice(void (*cb)(loggerjob_t *, void *) = NULL, void *param = NULL);
+  uint32_t fixRTCdatetime(void (*cb)(loggerjob_t *, void *) = NULL, void *param = NULL);
+  uint32_t getLogFormat(void (*cb)(loggerjob_t *, void *) = NULL, void *param = NULL);
+  uint32_t setLogFormat(uint32_t format, void (*cb)(loggerjob_t *, void *) = NULL, void *param = NULL);
+  uint32_t getLogMode(void (*cb)(loggerjob_t *, void *) = NULL, void *param = NULL);
+  uint32_t setLogMode(recordmode_t recmode, logcriteria_t criteria, void (*cb)(loggerjob_t *, void *) = NULL,
+                      void *param = NULL);
+};
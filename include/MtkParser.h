@@ -5,6 +5,7 @@
 #include "CommonTypes.h"
 #include "GpxFileWriter.h"
 #include "MtkFileReader.h"
+#include "TrackSimplifier.h"
 
 #define SIZE_SECTOR 0x010000  // 65536 bytes
 #define SIZE_HEADER 0x000200  // 512 bytes
@@ -43,6 +44,8 @@ typedef struct _parseopt {
   trackmode_t trackMode;
   float timeOffset;
   bool putWaypts;
+  bool compress;
+  float simplifyTolerance;  // unit: meter (0: disabled)
 } parseopt_t;
 
 typedef struct _parsestatus {
@@ -72,17 +75,24 @@ class MtkParser {
 
   MtkFileReader *in;
   GpxFileWriter *out;
+  TrackSimplifier *simplifier;
   parseopt_t options;
   parsestatus_t status;
 
+  void endTrack();
+  uint32_t getLastTime();
+  uint16_t getRecordSize();
   bool isDifferentDate(uint32_t t1, uint32_t t2);
   bool matchBinPattern(const char *ptn, uint8_t len);
   bool readBinMarkers();
   bool readBinRecord(gpsrecord_t *rcd);
+  void putTrkpt(gpsrecord_t rcd);
   void setOptions(parseopt_t opts);
   void setRecordFormat(uint32_t fmt);
 
  public:
   MtkParser(parseopt_t opts);
-  gpxinfo_t convert(File32 *input, File32 *output, void (*rateCallback)(int32_t, int32_t));
+  gpxinfo_t convert(File32 *input, File32 *output, void (*rateCallback)(int32_t, int32_t),
+                    void (*rolloverCallback)(File32 *, File32 *, gpxinfo_t) = NULL,
+                    File32 *statsOutput = NULL);
 };
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "MtkLoggerTask.h"
+
+class MtkSession {
+ private:
+  static const uint8_t CONNECT_RETRIES = 2;
+  static const uint32_t DEFAULT_IDLE_TIMEOUT = 60000;
+  static const uint32_t DEFAULT_KEEPALIVE_INTERVAL = 10000;
+  static const uint32_t JOB_TIMEOUT = 30000;
+
+  /*
+   * Note:
+   * The session keeps the SPP link to the logger open across the operations, since a Bluetooth Classic connection
+   * takes seconds and often fails. The link is checked with a keepalive before it is reused and reconnected if it has
+   * dropped. poll() must be called periodically while the app is idle (not while a logger job is running) to send the
+   * keepalives and to close the link after the idle timeout.
+   * The operations on the link are run as the jobs of the logger task, and the calling task sleeps until they complete.
+   */
+
+  MtkLoggerTask *task;
+  uint8_t address[6];
+  uint32_t idleTimeout;
+  uint32_t keepAliveInterval;
+  uint32_t lastUsedAt;
+  uint32_t lastAliveAt;
+  bool opened;
+
+  bool isSameAddress(const uint8_t *addr);
+  bool runJob(uint32_t id);
+  bool reconnect();
+
+ public:
+  MtkSession(MtkLoggerTask *tsk, uint32_t idleTmo = DEFAULT_IDLE_TIMEOUT,
+             uint32_t keepAliveIntv = DEFAULT_KEEPALIVE_INTERVAL);
+
+  bool open(const uint8_t *addr);
+  void release();
+  void close();
+  void poll();
+  bool isOpen();
+};
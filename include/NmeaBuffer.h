@@ -2,38 +2,38 @@
 
 #include <Arduino.h>
 
-#define BP_BUFFER_SIZE 512
+#include "NmeaClassifier.h"
 
-typedef struct bufferpage {
-  char buf[BP_BUFFER_SIZE + 1];
-  bufferpage *next;
-} bufferpage_t;
+#define NB_BUFFER_SIZE 4160  // >= the largest PMTK reply ("$PMTK182,8,AAAAAAAA," + 0x800 bytes in hex + "*CS")
 
 class NmeaBuffer {
  private:
-  bufferpage_t *rootPage;
-  bufferpage_t *currentPage;
+  /*
+   * Note:
+   * The buffer is a fixed arena allocated once with the object. It is never freed nor re-allocated while receiving,
+   * and clear() only resets the positions, to avoid the heap fragmentation during a long download.
+   */
+  char buf[NB_BUFFER_SIZE + 1];
   uint16_t ptr;
-  uint32_t dataLength;
+  uint16_t dataLength;
   uint8_t columnCount;
   uint8_t expectedChecksum;
   uint8_t receivedChecksum;
+  NmeaClassifier classifier;
 
   static bool isValidChar(char ch);
   static uint8_t hexCharToByte(char ch);
-  bufferpage_t *allocatePage(bufferpage_t **pg);
-  void freePages(bufferpage_t *tgp);
   void appendToBuffer(char ch);
   void updateChecksum(char ch);
 
  public:
   NmeaBuffer();
-  ~NmeaBuffer();
 
   void clear();
   bool put(const char ch);
   char get();
   char *getBuffer();
+  nmeatype_t getType();
   bool readHexByteFull(byte *by);
   bool readHexByteHalf(byte *by);
   bool readColumnAsInt(uint8_t clm, int32_t *value, bool hex);
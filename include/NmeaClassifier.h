@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Arduino.h>
+
+typedef enum _nmeatype {
+  NMEA_PENDING = 0,  // not classified yet
+  NMEA_DATA = 1,     // $PMTK182,8 (log data)
+  NMEA_VALUE = 2,    // $PMTK182,3 (log setting value)
+  NMEA_ACK = 3,      // $PMTK001 (acknowledge: cmd,status)
+  NMEA_RELEASE = 4,  // $PMTK705 (firmware release)
+  NMEA_SYSMSG = 5,   // $PMTK010 (system message)
+  NMEA_PMTK = 6,     // other PMTK sentences
+  NMEA_DROP = 7,     // non-PMTK sentences (GGA, RMC and so on; not buffered)
+  NMEA_TYPES = 8
+} nmeatype_t;
+
+typedef struct _nmeaprefix {
+  const char *prefix;
+  uint8_t length;
+  nmeatype_t type;
+} nmeaprefix_t;
+
+class NmeaClassifier {
+ private:
+  static const nmeaprefix_t PREFIXES[];
+  static const uint8_t PREFIX_COUNT;
+
+  /*
+   * Note:
+   * The classifier keeps the set of the prefixes still matching (as a bitmap) and narrows it down with each character
+   * as it arrives, so the type of a sentence is known after its first few fields without scanning the buffer.
+   */
+
+  uint8_t candidates;
+  uint8_t pos;
+  nmeatype_t matched;  // the longest prefix completed so far
+  nmeatype_t type;
+
+ public:
+  NmeaClassifier();
+
+  void reset();
+  nmeatype_t put(char ch);
+  nmeatype_t getType();
+  static nmeatype_t classify(const char *str);
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Arduino.h>
+
+class RxRingBuffer {
+ private:
+  /*
+   * Note:
+   * A lock-free single-producer / single-consumer ring. push() is called only from the Bluetooth task and pop() only
+   * from the task using the logger. Each side writes only its own index, and the indexes are published with the
+   * release/acquire ordering so that the data is visible before the index on both cores.
+   */
+
+  uint8_t *buf;
+  uint32_t size;  // must be a power of 2
+  uint32_t mask;
+  volatile uint32_t head;  // written by the producer
+  volatile uint32_t tail;  // written by the consumer
+  volatile uint32_t highWater;
+  volatile uint32_t overflow;
+
+ public:
+  RxRingBuffer(uint32_t capacity);
+  ~RxRingBuffer();
+
+  size_t available();
+  void clear();
+  uint32_t getHighWater();
+  uint32_t getOverflow();
+  size_t pop(uint8_t *data, size_t len);
+  size_t push(const uint8_t *data, size_t len);
+  void resetStats();
+};
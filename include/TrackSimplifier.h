@@ -0,0 +1,31 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdlib.h>
+
+#include "CommonTypes.h"
+#include "GpxFileWriter.h"
+
+#define SIMPLIFIER_WINDOW 32  // max number of pending TRKPTs (bounds the memory and the cost per point)
+
+class TrackSimplifier {
+ private:
+  GpxFileWriter *out;
+  float tolerance;
+  gpsrecord_t window[SIMPLIFIER_WINDOW];
+  uint8_t count;
+  uint32_t dropCount;
+
+  static bool hasPosition(const gpsrecord_t *rcd);
+  static float distanceToSegment(const gpsrecord_t *p, const gpsrecord_t *a, const gpsrecord_t *b);
+  bool isWithinTolerance(const gpsrecord_t *rcd);
+
+ public:
+  TrackSimplifier(GpxFileWriter *output, float tolerance);
+
+  void endTrack();
+  void flush();
+  uint32_t getDroppedCount();
+  uint32_t getLastTime();
+  void putTrkpt(gpsrecord_t rcd);
+};
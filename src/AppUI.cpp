@@ -7,6 +7,7 @@ AppUI::AppUI() {
 
   appIcon = NULL;
   appTitle = "MyApp";
+  pollCallback = NULL;
   strncpy(appHint[0], "", APP_HINT_LEN);
   strncpy(appHint[1], "", APP_HINT_LEN);
   btIcon = {true, false};
@@ -415,6 +416,10 @@ void AppUI::setIdleCallback(void (*callback)(), uint32_t timeout) {
   idleTimeout = timeout;
 }
 
+void AppUI::setPollCallback(void (*callback)()) {
+  pollCallback = callback;
+}
+
 void AppUI::setIconVisible(bool btVisible, bool sdVisible) {
   if ((btIcon.visible == btVisible) && (sdIcon.visible == sdVisible)) return;
 
@@ -449,6 +454,7 @@ btnid_t AppUI::promptCustom(navmenu_t* nav) {
     if ((idleTimeout > 0) && (idleTime > idleTimeout)) {
       if (idleCallback != NULL) idleCallback();
     }
+    if (pollCallback != NULL) pollCallback();
 
     btn = checkButtonInput(nav);
     delay(LOOP_WAIT);
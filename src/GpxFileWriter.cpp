@@ -1,16 +1,27 @@
 #include "GpxFileWriter.h"
 
-GpxFileWriter::GpxFileWriter(File32 *output) {
+GpxFileWriter::GpxFileWriter(File32 *output, bool compress) {
   out = output;
+  statsOut = NULL;
+  gzout = (compress) ? new GzipFileWriter(output) : NULL;
 
   setTimeOffset(0);  // set offsetSec as 0 and timeOffsetStr as "Z"
 
+  sizeHint = 0;
+  preAllocated = false;
+  rolloverCallback = NULL;
+  memset(&totalInfo, 0, sizeof(gpxinfo_t));
+  memset(&lastTrkpt, 0, sizeof(gpsrecord_t));
+  refEle = 0;
+  statsCount = 0;
   inGpx = false;
   inTrack = false;
   inTrkSeg = false;
 }
 
 GpxFileWriter::~GpxFileWriter() {
+  if (gzout != NULL) delete gzout;
+
   out->flush();
 }
 
@@ -34,7 +45,7 @@ void GpxFileWriter::beginTrack() {
   if (!inGpx) beginGpx();
   if (inTrack) endTrack();
 
-  out->write("<trk>\n");
+  write("<trk>\n");
 
   // set the flag to indicate the GPX track is started
   inTrack = true;
@@ -43,14 +54,15 @@ void GpxFileWriter::beginTrack() {
 
   // update the track count in the GPX data
   gpxInfo.trackCount += 1;
-  memset(&trackInfo, 0, sizeof(gpxinfo_t));  // clear the track information
+  memset(&trackInfo, 0, sizeof(gpxinfo_t));     // clear the track information
+  memset(&lastTrkpt, 0, sizeof(gpsrecord_t));  // never connect the statistics across tracks
 }
 
 void GpxFileWriter::beginTrackSeg() {
   if (!inTrack) beginTrack();
   if (inTrkSeg) endTrackSeg();
 
-  out->write("<trkseg>\n");
+  write("<trkseg>\n");
 
   // set the flag to indicate the GPX track segment is started
   inTrkSeg = true;
@@ -65,14 +77,37 @@ void GpxFileWriter::beginGpx() {
   // truncate the existing data in the output file
   out->truncate(0);
 
+  // pre-allocate a contiguous extent for the estimated size of the output file.
+  // this avoids allocating clusters and updating the FAT each time the file grows.
+  // if there is not enough contiguous free space, the file grows as usual.
+  // Note: skip it when the output is split into files because the hint is the size of the whole log
+  preAllocated = ((sizeHint > 0) && (rolloverCallback == NULL) && (out->preAllocate(sizeHint)));
+  if (preAllocated) {
+    Serial.printf("Writer.begin: pre-allocated %d bytes\n", sizeHint);
+  }
+
+  // start a gzip stream if the output is compressed
+  if (gzout != NULL) gzout->begin();
+
   // write the header of the GPX data
-  out->write(
+  write(
       "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
       "<gpx version=\"1.1\" creator=\"" PARSER_DESCR
       "\""
       " xmlns:xsi=\"http://www.w3.org/2001/XMLSchema\""
       " xmlns=\"https://www.topografix.com/GPX/1/1/gpx.xsd\">\n");
 
+  // write the header of the statistics (JSON) if the sidecar output is set
+  if (statsOut != NULL) {
+    statsOut->truncate(0);
+    statsOut->write(
+        "{\"creator\":\"" PARSER_DESCR
+        "\",\n"
+        "\"units\":{\"distance\":\"m\",\"time\":\"s\",\"speed\":\"m/s\",\"elevation\":\"m\"},\n"
+        "\"tracks\":[");
+    statsCount = 0;
+  }
+
   // initialize the GPX and track information
   memset(&gpxInfo, 0, sizeof(gpxinfo_t));
   memset(&trackInfo, 0, sizeof(gpxinfo_t));
@@ -86,6 +121,16 @@ void GpxFileWriter::beginGpx() {
 void GpxFileWriter::endTrack() {
   if (!inTrack) return;
 
+  closeTrack();
+
+  // finish the current file at the track boundary if the rollover callback is set
+  // (the callback opens the next file, and the next GPX data is started when a TRKPT is put)
+  if (rolloverCallback != NULL) endGpx();
+}
+
+void GpxFileWriter::closeTrack() {
+  if (!inTrack) return;
+
   // close the track segment (if it is opened)
   endTrackSeg();
 
@@ -98,10 +143,10 @@ void GpxFileWriter::endTrack() {
     uint16_t drMin = (duration % 3600) / 60;
 
     // put the track data summary as the track name
-    out->write("<name>");
-    out->write(timeToString(buf, trackInfo.startTime));
-    out->write(" to ");
-    out->write(timeToString(buf, trackInfo.endTime));
+    write("<name>");
+    write(timeToString(buf, trackInfo.startTime));
+    write(" to ");
+    write(timeToString(buf, trackInfo.endTime));
     if (trackInfo.wayptCount == 0) {
       sprintf(buf, " (%d hours %d minutes, %d TRKPTs)",  //
               drHour, drMin, trackInfo.trkptCount);
@@ -109,12 +154,19 @@ void GpxFileWriter::endTrack() {
       sprintf(buf, " (%d hours %d minutes, %d TRKPTs, %d WAYPTs)",  //
               drHour, drMin, trackInfo.trkptCount, trackInfo.wayptCount);
     }
-    out->write(buf);
-    out->write("</name>\n");
+    write(buf);
+    write("</name>\n");
+
+    // put the statistics of the track into the sidecar
+    if (statsOut != NULL) {
+      statsOut->write((statsCount == 0) ? "\n" : ",\n");
+      putStats(&trackInfo);
+      statsCount += 1;
+    }
   }
 
   // close the track
-  out->write("</trk>\n");
+  write("</trk>\n");
 
   // put the waypts added in the last track
   for (int16_t i = 0; i < MAX_WAYPTS_PER_TRK; i++) {
@@ -131,7 +183,7 @@ void GpxFileWriter::endTrack() {
 void GpxFileWriter::endTrackSeg() {
   if (!inTrkSeg) return;
 
-  out->write("</trkseg>\n");
+  write("</trkseg>\n");
   inTrkSeg = false;
 }
 
@@ -139,7 +191,7 @@ gpxinfo_t GpxFileWriter::endGpx() {
   if (!inGpx) return gpxInfo;
 
   // close the track (if it is opened)
-  endTrack();
+  closeTrack();
 
   // put the name of the GPX data if there is any track data
   if (gpxInfo.trkptCount > 0) {
@@ -151,10 +203,10 @@ gpxinfo_t GpxFileWriter::endGpx() {
     uint16_t drMin = (duration % 3600) / 60;
 
     // put the track data summary as the gpx name
-    out->write("<name>");
-    out->write(timeToString(buf, gpxInfo.startTime));
-    out->write(" to ");
-    out->write(timeToString(buf, gpxInfo.endTime));
+    write("<name>");
+    write(timeToString(buf, gpxInfo.startTime));
+    write(" to ");
+    write(timeToString(buf, gpxInfo.endTime));
     if (gpxInfo.wayptCount == 0) {
       sprintf(buf, " (%d days %d hours %d minutes, %d TRKs, %d TRKPTs)",  //
               drDay, drHour, drMin, gpxInfo.trackCount, gpxInfo.trkptCount);
@@ -162,12 +214,27 @@ gpxinfo_t GpxFileWriter::endGpx() {
       sprintf(buf, " (%d days %d hours %d minutes, %d TRKs, %d TRKPTs, %d WAYPTs)",  //
               drDay, drHour, drMin, gpxInfo.trackCount, gpxInfo.trkptCount, gpxInfo.wayptCount);
     }
-    out->write(buf);
-    out->write("</name>\n");
+    write(buf);
+    write("</name>\n");
   }
 
   // close the GPX data
-  out->write("</gpx>\n");
+  write("</gpx>\n");
+
+  // put the statistics of the whole file and close the sidecar
+  if (statsOut != NULL) {
+    statsOut->write("\n],\n\"file\":");
+    putStats(&gpxInfo);
+    statsOut->write("}\n");
+    statsOut->flush();
+  }
+
+  // close the gzip stream if the output is compressed
+  if (gzout != NULL) gzout->end();
+
+  // truncate the pre-allocated extent to the actual length
+  if (preAllocated) out->truncate(out->curPosition());
+  preAllocated = false;
   out->flush();
 
   // set the flag to indicate the GPX data is ended
@@ -175,9 +242,179 @@ gpxinfo_t GpxFileWriter::endGpx() {
   inTrack = false;
   inTrkSeg = false;
 
+  // accumulate the information of all GPX data written by this writer
+  mergeStats(&totalInfo, &gpxInfo);
+  if (totalInfo.startTime == 0) totalInfo.startTime = gpxInfo.startTime;
+  if (gpxInfo.endTime != 0) totalInfo.endTime = gpxInfo.endTime;
+  totalInfo.trkptCount += gpxInfo.trkptCount;
+  totalInfo.trackCount += gpxInfo.trackCount;
+  totalInfo.wayptCount += gpxInfo.wayptCount;
+
+  // notify the file is finished to switch the output to the next file
+  if (rolloverCallback != NULL) rolloverCallback(out, statsOut, gpxInfo);
+
   return gpxInfo;
 }
 
+void GpxFileWriter::write(const char *str) {
+  // write the string to the output file directly or through the gzip stream
+  if (gzout != NULL) {
+    gzout->write(str);
+  } else {
+    out->write(str);
+  }
+}
+
+void GpxFileWriter::estimateSize(uint32_t inputSize, uint16_t recordSize, uint32_t format) {
+  const uint16_t HEADER_SIZE = 512;  // GPX header, footer and names (approx.)
+  const uint8_t GZIP_RATIO = 4;      // conservative ratio (GPX is usually compressed to 1/8-1/15)
+
+  if (recordSize == 0) return;
+
+  // calculate the size of a TRKPT from the fields to be written
+  // e.g. <trkpt lat="-35.123456" lon="-139.123456"><time>2024-01-01T00:00:00Z</time>...</trkpt>
+  uint16_t trkptSize = 16;                   // "<trkpt" ">" "</trkpt>\n"
+  if (format & FMT_LAT) trkptSize += 17;     // " lat=\"...\""
+  if (format & FMT_LON) trkptSize += 18;     // " lon=\"...\""
+  if (format & FMT_TIME) trkptSize += 33;    // "<time>...</time>"
+  if (format & FMT_HEIGHT) trkptSize += 20;  // "<ele>...</ele>"
+  if (format & FMT_SPEED) trkptSize += 22;   // "<speed>...</speed>"
+
+  // estimate the output size from the number of records in the input
+  sizeHint = ((inputSize / recordSize) * trkptSize) + HEADER_SIZE;
+  if (gzout != NULL) sizeHint /= GZIP_RATIO;
+}
+
+void GpxFileWriter::putStats(gpxinfo_t *info) {
+  char buf[96], tstr[32];
+  gpxstats_t *st = &info->stats;
+
+  // average speed while moving
+  float avgSpeed = (st->movingTime > 0) ? (st->distance / st->movingTime) : 0;
+
+  statsOut->write("{\"start\":\"");
+  statsOut->write(timeToISO8601(tstr, info->startTime));
+  statsOut->write("\",\"end\":\"");
+  statsOut->write(timeToISO8601(tstr, info->endTime));
+  sprintf(buf, "\",\"trkpts\":%d,\"wpts\":%d,", info->trkptCount, info->wayptCount);
+  statsOut->write(buf);
+  sprintf(buf, "\"distance\":%.1f,\"movingTime\":%u,\"maxSpeed\":%.2f,\"avgSpeed\":%.2f,",  //
+          st->distance, st->movingTime, st->maxSpeed, avgSpeed);
+  statsOut->write(buf);
+  sprintf(buf, "\"eleGain\":%.1f,\"eleLoss\":%.1f,", st->eleGain, st->eleLoss);
+  statsOut->write(buf);
+  sprintf(buf, "\"bounds\":[%.6f,%.6f,%.6f,%.6f]}",  // [south, west, north, east]
+          st->minLat, st->minLon, st->maxLat, st->maxLon);
+  statsOut->write(buf);
+}
+
+void GpxFileWriter::updateStats(gpsrecord_t rcd) {
+  if (!((rcd.format & FMT_LAT) && (rcd.format & FMT_LON))) return;
+
+  float dist = 0;
+  uint32_t movingSec = 0;
+  float gain = 0;
+  float loss = 0;
+  float speed = (rcd.format & FMT_SPEED) ? rcd.speed : 0;
+
+  if (lastTrkpt.format != 0) {
+    dist = distance(lastTrkpt.latitude, lastTrkpt.longitude, rcd.latitude, rcd.longitude);
+
+    // count the distance and time only while moving to ignore the position jitter at a stop.
+    // (if the TIME field is not recorded, count all the distance)
+    if ((rcd.format & FMT_TIME) && (lastTrkpt.format & FMT_TIME)) {
+      int32_t dt = (rcd.time - lastTrkpt.time);
+      float segSpeed = (dt > 0) ? (dist / dt) : 0;
+
+      if (segSpeed >= MOVING_SPEED) {
+        movingSec = dt;
+      } else {
+        dist = 0;
+      }
+      if (!(rcd.format & FMT_SPEED)) speed = segSpeed;
+    }
+  }
+
+  // count the elevation change only when it exceeds the threshold to ignore the altitude noise
+  if (rcd.format & FMT_HEIGHT) {
+    if (!(lastTrkpt.format & FMT_HEIGHT)) {
+      refEle = rcd.altitude;
+    } else if ((rcd.altitude - refEle) >= ELE_THRESHOLD) {
+      gain = (rcd.altitude - refEle);
+      refEle = rcd.altitude;
+    } else if ((refEle - rcd.altitude) >= ELE_THRESHOLD) {
+      loss = (refEle - rcd.altitude);
+      refEle = rcd.altitude;
+    }
+  }
+  memcpy(&lastTrkpt, &rcd, sizeof(gpsrecord_t));
+
+  // update the statistics of the GPX data and the track
+  gpxinfo_t *infos[] = {&gpxInfo, &trackInfo};
+  for (uint8_t i = 0; i < 2; i++) {
+    gpxstats_t *st = &infos[i]->stats;
+
+    if (st->posCount == 0) {
+      st->minLat = st->maxLat = rcd.latitude;
+      st->minLon = st->maxLon = rcd.longitude;
+    } else {
+      if (rcd.latitude < st->minLat) st->minLat = rcd.latitude;
+      if (rcd.latitude > st->maxLat) st->maxLat = rcd.latitude;
+      if (rcd.longitude < st->minLon) st->minLon = rcd.longitude;
+      if (rcd.longitude > st->maxLon) st->maxLon = rcd.longitude;
+    }
+    st->posCount += 1;
+
+    st->distance += dist;
+    st->movingTime += movingSec;
+    st->eleGain += gain;
+    st->eleLoss += loss;
+    if (speed > st->maxSpeed) st->maxSpeed = speed;
+  }
+}
+
+void GpxFileWriter::mergeStats(gpxinfo_t *dst, const gpxinfo_t *src) {
+  const gpxstats_t *ss = &src->stats;
+  gpxstats_t *ds = &dst->stats;
+
+  if (src->trkptCount == 0) return;
+
+  // merge the bounding box (copy it if the destination has no position yet)
+  if ((ss->posCount > 0) && (ds->posCount == 0)) {
+    ds->minLat = ss->minLat;
+    ds->minLon = ss->minLon;
+    ds->maxLat = ss->maxLat;
+    ds->maxLon = ss->maxLon;
+  } else if (ss->posCount > 0) {
+    if (ss->minLat < ds->minLat) ds->minLat = ss->minLat;
+    if (ss->minLon < ds->minLon) ds->minLon = ss->minLon;
+    if (ss->maxLat > ds->maxLat) ds->maxLat = ss->maxLat;
+    if (ss->maxLon > ds->maxLon) ds->maxLon = ss->maxLon;
+  }
+  ds->posCount += ss->posCount;
+
+  ds->distance += ss->distance;
+  ds->movingTime += ss->movingTime;
+  ds->eleGain += ss->eleGain;
+  ds->eleLoss += ss->eleLoss;
+  if (ss->maxSpeed > ds->maxSpeed) ds->maxSpeed = ss->maxSpeed;
+}
+
+float GpxFileWriter::distance(double lat1, double lon1, double lat2, double lon2) {
+  const float RAD_PER_DEG = (M_PI / 180.0);
+
+  // great-circle distance by the haversine formula
+  // (the differences are taken in double to keep the precision for short segments)
+  float dLat = (float)(lat2 - lat1) * RAD_PER_DEG;
+  float dLon = (float)(lon2 - lon1) * RAD_PER_DEG;
+  float sLat = sinf(dLat / 2);
+  float sLon = sinf(dLon / 2);
+  float a = (sLat * sLat) + cosf((float)lat1 * RAD_PER_DEG) * cosf((float)lat2 * RAD_PER_DEG) * (sLon * sLon);
+  if (a > 1) a = 1;  // avoid NaN by the rounding error
+
+  return (2 * EARTH_RADIUS * asinf(sqrtf(a)));
+}
+
 void GpxFileWriter::putTrackPoint(gpsrecord_t rcd, bool asWpt) {
   const char *tag = (asWpt) ? "wpt" : "trkpt";
 
@@ -185,18 +422,18 @@ void GpxFileWriter::putTrackPoint(gpsrecord_t rcd, bool asWpt) {
     Serial.printf("%s, (%.3f %.3f)\n", tag, rcd.latitude, rcd.longitude);
   }
 
-  out->write("<");
-  out->write(tag);
+  write("<");
+  write(tag);
   putLatLon(rcd);
-  out->write(">");
+  write(">");
 
   putTime(rcd);
   putHeight(rcd);
   putSpeed(rcd);
 
-  out->write("</");
-  out->write(tag);
-  out->write(">\n");
+  write("</");
+  write(tag);
+  write(">\n");
 }
 
 void GpxFileWriter::putLatLon(gpsrecord_t rcd) {
@@ -204,11 +441,11 @@ void GpxFileWriter::putLatLon(gpsrecord_t rcd) {
 
   if (rcd.format & FMT_LAT) {
     sprintf(buf, " lat=\"%.6f\"", rcd.latitude);
-    out->write(buf);
+    write(buf);
   }
   if (rcd.format & FMT_LON) {
     sprintf(buf, " lon=\"%.6f\"", rcd.longitude);
-    out->write(buf);
+    write(buf);
   }
 }
 
@@ -217,7 +454,7 @@ void GpxFileWriter::putHeight(gpsrecord_t rcd) {
 
   if (rcd.format & FMT_HEIGHT) {
     sprintf(buf, "<ele>%.2f</ele>", rcd.altitude);
-    out->write(buf);
+    write(buf);
   }
 }
 
@@ -226,7 +463,7 @@ void GpxFileWriter::putSpeed(gpsrecord_t rcd) {
 
   if (rcd.format & FMT_SPEED) {
     sprintf(buf, "<speed>%.2f</speed>", rcd.speed);
-    out->write(buf);
+    write(buf);
   }
 }
 
@@ -234,9 +471,9 @@ void GpxFileWriter::putTime(gpsrecord_t rcd) {
   char buf[32];
 
   if (rcd.format & FMT_TIME) {
-    out->write("<time>");
-    out->write(timeToISO8601(buf, rcd.time));
-    out->write("</time>");
+    write("<time>");
+    write(timeToISO8601(buf, rcd.time));
+    write("</time>");
   }
 }
 
@@ -246,6 +483,9 @@ void GpxFileWriter::putTrkpt(const gpsrecord_t rcd) {
   // put a TRKPT
   putTrackPoint(rcd, false);
 
+  // update the statistics before updating the number of TRKPTs
+  updateStats(rcd);
+
   // update the start/end time of the GPX data and the track
   if (rcd.format & FMT_TIME) {
     if (gpxInfo.startTime == 0) gpxInfo.startTime = rcd.time;
@@ -268,10 +508,22 @@ void GpxFileWriter::putWaypt(gpsrecord_t rcd) {
   // Note: never update the number of WAYPTs here (addWaypt)
 }
 
+gpxinfo_t GpxFileWriter::getTotalInfo() {
+  return totalInfo;
+}
+
 uint32_t GpxFileWriter::getLastTime() {
   return gpxInfo.endTime;
 }
 
+void GpxFileWriter::setRolloverCallback(void (*callback)(File32 *, File32 *, gpxinfo_t)) {
+  rolloverCallback = callback;
+}
+
+void GpxFileWriter::setStatsOutput(File32 *output) {
+  statsOut = output;
+}
+
 void GpxFileWriter::setTimeOffset(float td) {
   offsetSec = 3600 * td;
 }
@@ -0,0 +1,353 @@
+#include "GzipFileWriter.h"
+
+// base values and extra bits of the length codes (257-285) and the distance codes (0-29)
+static const uint16_t LEN_BASE[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LEN_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                      2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DIST_BASE[30] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                       193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                       6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// CRC-32 (IEEE 802.3) lookup table for 4-bit nibbles
+static const uint32_t CRC_TABLE[16] = {0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+                                       0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+                                       0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+/**
+ * @fn GzipFileWriter::GzipFileWriter(File32 *output)
+ * @brief Constructor of the GzipFileWriter class. Prepare the fixed Huffman code table used by the compressor.
+ * @param output A pointer to the output file object to write the compressed data.
+ */
+GzipFileWriter::GzipFileWriter(File32 *output) {
+  out = output;
+  inStream = false;
+
+  // make the fixed Huffman codes of the literal/length alphabet (RFC1951 3.2.6)
+  // the codes are stored in bit-reversed order because deflate packs them from the LSB
+  for (uint16_t sym = 0; sym < 288; sym++) {
+    if (sym < 144) {
+      litCodes[sym] = reverseBits(0x030 + sym, 8);
+    } else if (sym < 256) {
+      litCodes[sym] = reverseBits(0x190 + (sym - 144), 9);
+    } else if (sym < 280) {
+      litCodes[sym] = reverseBits(0x000 + (sym - 256), 7);
+    } else {
+      litCodes[sym] = reverseBits(0x0C0 + (sym - 280), 8);
+    }
+  }
+}
+
+/**
+ * @fn uint16_t GzipFileWriter::reverseBits(uint16_t code, uint8_t len)
+ * @brief Reverse the order of the lower len bits of the given code.
+ */
+uint16_t GzipFileWriter::reverseBits(uint16_t code, uint8_t len) {
+  uint16_t rev = 0;
+  for (uint8_t i = 0; i < len; i++) {
+    rev = (rev << 1) | (code & 1);
+    code >>= 1;
+  }
+
+  return rev;
+}
+
+/**
+ * @fn uint16_t GzipFileWriter::hash(const uint8_t *p)
+ * @brief Calculate the hash value of 3 bytes from the given pointer to look up the match candidates.
+ */
+uint16_t GzipFileWriter::hash(const uint8_t *p) {
+  uint32_t val = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+  return (uint16_t)((val * 2654435761u) >> (32 - HASH_BITS));
+}
+
+/**
+ * @fn void GzipFileWriter::begin()
+ * @brief Start a new gzip stream in the output file. The gzip header and the header of the deflate block are written.
+ */
+void GzipFileWriter::begin() {
+  outLen = 0;
+  bitBuf = 0;
+  bitCount = 0;
+  strStart = 0;
+  lookEnd = 0;
+  crc = 0xFFFFFFFF;
+  inSize = 0;
+
+  memset(head, 0xFF, sizeof(head));  // fill with HASH_NIL
+  memset(prev, 0xFF, sizeof(prev));  // fill with HASH_NIL
+
+  // put the gzip header (RFC1952; ID1, ID2, CM=deflate, FLG=0, MTIME=0, XFL=0, OS=unknown)
+  const uint8_t GZIP_HEADER[10] = {0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF};
+  for (uint8_t i = 0; i < sizeof(GZIP_HEADER); i++) putByte(GZIP_HEADER[i]);
+
+  // open a deflate block compressed with the fixed Huffman codes (BFINAL=0, BTYPE=01)
+  // Note: the block is kept open until end() is called
+  putBits(0, 1);
+  putBits(1, 2);
+
+  inStream = true;
+}
+
+/**
+ * @fn void GzipFileWriter::end()
+ * @brief Compress the remaining data and close the gzip stream. The gzip trailer (CRC32 and size of the original data)
+ * is written and all buffered data is written to the output file.
+ */
+void GzipFileWriter::end() {
+  if (!inStream) return;
+
+  // compress all remaining data and close the current block
+  compressWindow(true);
+  putLiteral(256);
+
+  // put an empty final block (BFINAL=1, BTYPE=01) to terminate the deflate stream
+  putBits(1, 1);
+  putBits(1, 2);
+  putLiteral(256);
+  flushBits();
+
+  // put the gzip trailer (CRC32 and ISIZE in little endian)
+  uint32_t crcVal = ~crc;
+  for (uint8_t i = 0; i < 4; i++) putByte((crcVal >> (8 * i)) & 0xFF);
+  for (uint8_t i = 0; i < 4; i++) putByte((inSize >> (8 * i)) & 0xFF);
+  flushOutput();
+
+  inStream = false;
+}
+
+/**
+ * @fn uint32_t GzipFileWriter::inputSize()
+ * @brief Return the size of the uncompressed data written in the current stream.
+ */
+uint32_t GzipFileWriter::inputSize() {
+  return inSize;
+}
+
+/**
+ * @fn size_t GzipFileWriter::write(const char *str)
+ * @brief Compress the given null-terminated string and write it to the output file.
+ * @param str A pointer to the string to write.
+ * @return Returns the number of bytes accepted.
+ */
+size_t GzipFileWriter::write(const char *str) {
+  return write((const uint8_t *)str, strlen(str));
+}
+
+/**
+ * @fn size_t GzipFileWriter::write(const uint8_t *data, size_t len)
+ * @brief Compress the given data and write it to the output file. The data is buffered in the LZ77 window and is
+ * compressed when the window is filled.
+ * @param data A pointer to the data to write.
+ * @param len The length of the data.
+ * @return Returns the number of bytes accepted.
+ */
+size_t GzipFileWriter::write(const uint8_t *data, size_t len) {
+  if (!inStream) return 0;
+
+  updateCrc(data, len);
+  inSize += len;
+
+  size_t remain = len;
+  while (remain > 0) {
+    // copy the data into the lookahead area of the window
+    size_t cs = ((WINDOW_SIZE * 2) - lookEnd);
+    if (cs > remain) cs = remain;
+    memcpy(&window[lookEnd], data, cs);
+    lookEnd += cs;
+    data += cs;
+    remain -= cs;
+
+    // compress the data and slide the window if the window is full
+    if (lookEnd == (WINDOW_SIZE * 2)) {
+      compressWindow(false);
+      slideWindow();
+    }
+  }
+
+  return len;
+}
+
+/**
+ * @fn void GzipFileWriter::compressWindow(bool flush)
+ * @brief Compress the data in the window from the current position. If flush is false, the last MAX_MATCH bytes are
+ * kept in the window to find longer matches with the following data.
+ * @param flush Set true to compress all data in the window.
+ */
+void GzipFileWriter::compressWindow(bool flush) {
+  while (strStart < lookEnd) {
+    uint16_t avail = (lookEnd - strStart);
+    if ((!flush) && (avail < MAX_MATCH)) break;
+
+    // find the longest match of the current string in the window
+    uint16_t dist = 0;
+    uint16_t len = (avail >= MIN_MATCH) ? findMatch(strStart, &dist) : 0;
+
+    if (len >= MIN_MATCH) {
+      putMatch(len, dist);
+
+      // register the strings in the matched range to the hash chains
+      for (uint16_t i = 1; i < len; i++) {
+        if ((strStart + i + MIN_MATCH) <= lookEnd) insertString(strStart + i);
+      }
+      strStart += len;
+    } else {
+      putLiteral(window[strStart]);
+      strStart += 1;
+    }
+  }
+}
+
+/**
+ * @fn void GzipFileWriter::insertString(uint16_t pos)
+ * @brief Register the 3-byte string at the given position of the window to the hash chain.
+ */
+void GzipFileWriter::insertString(uint16_t pos) {
+  uint16_t h = hash(&window[pos]);
+
+  prev[pos & WINDOW_MASK] = head[h];
+  head[h] = pos;
+}
+
+/**
+ * @fn uint16_t GzipFileWriter::findMatch(uint16_t pos, uint16_t *dist)
+ * @brief Register the string at the given position to the hash chain and find the longest match in the window.
+ * @param pos The position of the string in the window.
+ * @param dist A pointer to the variable to store the distance of the match.
+ * @return Returns the length of the longest match (0 if not found).
+ */
+uint16_t GzipFileWriter::findMatch(uint16_t pos, uint16_t *dist) {
+  uint16_t h = hash(&window[pos]);
+  uint16_t cand = head[h];
+  prev[pos & WINDOW_MASK] = cand;
+  head[h] = pos;
+
+  uint16_t maxLen = (lookEnd - pos);
+  if (maxLen > MAX_MATCH) maxLen = MAX_MATCH;
+  uint16_t best = 0;
+
+  for (uint8_t chain = 0; chain < MAX_CHAIN; chain++) {
+    // stop if the candidate is invalid or out of the window
+    if ((cand == HASH_NIL) || (cand >= pos) || ((pos - cand) >= WINDOW_SIZE)) break;
+
+    // compare the candidate (check the byte at the current best length first to reject quickly)
+    if (window[cand + best] == window[pos + best]) {
+      uint16_t len = 0;
+      while ((len < maxLen) && (window[cand + len] == window[pos + len])) len++;
+
+      if (len > best) {
+        best = len;
+        *dist = (pos - cand);
+        if (len >= maxLen) break;
+      }
+    }
+
+    // go to the next (older) candidate
+    uint16_t next = prev[cand & WINDOW_MASK];
+    if (next >= cand) break;
+    cand = next;
+  }
+
+  return best;
+}
+
+/**
+ * @fn void GzipFileWriter::slideWindow()
+ * @brief Move the upper half of the window to the lower half and update the positions in the hash chains.
+ */
+void GzipFileWriter::slideWindow() {
+  memmove(window, &window[WINDOW_SIZE], WINDOW_SIZE);
+  strStart -= WINDOW_SIZE;
+  lookEnd -= WINDOW_SIZE;
+
+  for (uint16_t i = 0; i < HASH_SIZE; i++) {
+    head[i] = ((head[i] == HASH_NIL) || (head[i] < WINDOW_SIZE)) ? HASH_NIL : (head[i] - WINDOW_SIZE);
+  }
+  for (uint16_t i = 0; i < WINDOW_SIZE; i++) {
+    prev[i] = ((prev[i] == HASH_NIL) || (prev[i] < WINDOW_SIZE)) ? HASH_NIL : (prev[i] - WINDOW_SIZE);
+  }
+}
+
+/**
+ * @fn void GzipFileWriter::putLiteral(uint16_t sym)
+ * @brief Put a symbol of the literal/length alphabet with the fixed Huffman code.
+ */
+void GzipFileWriter::putLiteral(uint16_t sym) {
+  uint8_t len = (sym < 144) ? 8 : (sym < 256) ? 9 : (sym < 280) ? 7 : 8;
+  putBits(litCodes[sym], len);
+}
+
+/**
+ * @fn void GzipFileWriter::putMatch(uint16_t len, uint16_t dist)
+ * @brief Put a length/distance pair with the fixed Huffman codes.
+ */
+void GzipFileWriter::putMatch(uint16_t len, uint16_t dist) {
+  int8_t lc = 28;
+  while (LEN_BASE[lc] > len) lc--;
+  putLiteral(257 + lc);
+  putBits((len - LEN_BASE[lc]), LEN_EXTRA[lc]);
+
+  int8_t dc = 29;
+  while (DIST_BASE[dc] > dist) dc--;
+  putBits(reverseBits(dc, 5), 5);
+  putBits((dist - DIST_BASE[dc]), DIST_EXTRA[dc]);
+}
+
+/**
+ * @fn void GzipFileWriter::putBits(uint32_t value, uint8_t len)
+ * @brief Put the lower len bits of the value to the bit stream (from the LSB).
+ */
+void GzipFileWriter::putBits(uint32_t value, uint8_t len) {
+  bitBuf |= (value << bitCount);
+  bitCount += len;
+
+  while (bitCount >= 8) {
+    putByte(bitBuf & 0xFF);
+    bitBuf >>= 8;
+    bitCount -= 8;
+  }
+}
+
+/**
+ * @fn void GzipFileWriter::flushBits()
+ * @brief Put the remaining bits in the bit buffer with zero padding to the byte boundary.
+ */
+void GzipFileWriter::flushBits() {
+  if (bitCount > 0) putByte(bitBuf & 0xFF);
+
+  bitBuf = 0;
+  bitCount = 0;
+}
+
+/**
+ * @fn void GzipFileWriter::putByte(uint8_t by)
+ * @brief Put a byte to the output buffer. The buffer is written to the file when it is filled.
+ */
+void GzipFileWriter::putByte(uint8_t by) {
+  outBuf[outLen] = by;
+  outLen += 1;
+
+  if (outLen == OUT_SIZE) flushOutput();
+}
+
+/**
+ * @fn void GzipFileWriter::flushOutput()
+ * @brief Write the data in the output buffer to the output file.
+ */
+void GzipFileWriter::flushOutput() {
+  if (outLen > 0) out->write(outBuf, outLen);
+  outLen = 0;
+}
+
+/**
+ * @fn void GzipFileWriter::updateCrc(const uint8_t *data, size_t len)
+ * @brief Update the CRC32 value of the original data with the given data.
+ */
+void GzipFileWriter::updateCrc(const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ CRC_TABLE[crc & 0x0F];
+    crc = (crc >> 4) ^ CRC_TABLE[crc & 0x0F];
+  }
+}
@@ -0,0 +1,92 @@
+#include "HexDecoder.h"
+
+#include <string.h>
+
+// value of each character (HEX_INVALID for the characters that are not hexadecimal digits)
+const uint8_t HexDecoder::VALUES[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0x00
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0x10
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0x20
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0x30
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0x40
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0x50
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0x60
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0x70
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0x80
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0x90
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0xA0
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0xB0
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0xC0
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0xD0
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0xE0
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  // 0xF0
+};
+
+/**
+ * @fn size_t HexDecoder::decode(const char *src, size_t len, uint8_t *dst)
+ * @brief Decode a run of hexadecimal digits into bytes. The digits are decoded four bytes (eight characters) at a time
+ * while all of them are valid, and the rest is decoded a byte at a time.
+ * @param src A pointer to the hexadecimal digits.
+ * @param len The number of the characters available in src.
+ * @param dst A pointer to the buffer to store the decoded bytes (at least len / 2 bytes).
+ * @return Returns the number of the characters consumed (always even). The decoding stops at the first character that
+ * is not a hexadecimal digit, or before the last digit if it has no pair.
+ */
+size_t HexDecoder::decode(const char *src, size_t len, uint8_t *dst) {
+  const uint8_t *s = (const uint8_t *)src;
+  size_t i = 0;
+
+  // decode eight characters at a time. the upper bits of OR-ed values are set if any of them is invalid
+  while ((i + 8) <= len) {
+    uint8_t v0 = VALUES[s[i + 0]], v1 = VALUES[s[i + 1]];
+    uint8_t v2 = VALUES[s[i + 2]], v3 = VALUES[s[i + 3]];
+    uint8_t v4 = VALUES[s[i + 4]], v5 = VALUES[s[i + 5]];
+    uint8_t v6 = VALUES[s[i + 6]], v7 = VALUES[s[i + 7]];
+    if ((v0 | v1 | v2 | v3 | v4 | v5 | v6 | v7) & 0xF0) break;
+
+    dst[0] = (v0 << 4) | v1;
+    dst[1] = (v2 << 4) | v3;
+    dst[2] = (v4 << 4) | v5;
+    dst[3] = (v6 << 4) | v7;
+    dst += 4;
+    i += 8;
+  }
+
+  // decode the rest a byte at a time
+  while ((i + 2) <= len) {
+    uint8_t hi = VALUES[s[i]];
+    uint8_t lo = VALUES[s[i + 1]];
+    if ((hi | lo) & 0xF0) break;
+
+    *dst++ = (hi << 4) | lo;
+    i += 2;
+  }
+
+  return i;
+}
+
+/**
+ * @fn uint8_t HexDecoder::checksum(const char *src, size_t len)
+ * @brief Calculate the XOR of the characters (the NMEA checksum) four characters at a time.
+ * @param src A pointer to the characters.
+ * @param len The number of the characters.
+ * @return Returns the XOR of all characters.
+ */
+uint8_t HexDecoder::checksum(const char *src, size_t len) {
+  uint32_t acc = 0;
+  size_t i = 0;
+
+  // XOR 32-bit words, then fold the word into a byte
+  for (; (i + 4) <= len; i += 4) {
+    uint32_t w;
+    memcpy(&w, (src + i), sizeof(w));  // src may be unaligned
+    acc ^= w;
+  }
+  acc ^= (acc >> 16);
+  acc ^= (acc >> 8);
+
+  uint8_t chk = (uint8_t)acc;
+  for (; i < len; i++) chk ^= (uint8_t)src[i];
+
+  return chk;
+}
@@ -0,0 +1,218 @@
+#include "MtkDataDecoder.h"
+
+const char *MtkDataDecoder::HEADER = "PMTK182,8,";
+
+/**
+ * @fn MtkDataDecoder::MtkDataDecoder()
+ * @brief Constructor of MtkDataDecoder class. Clear the decoder state.
+ */
+MtkDataDecoder::MtkDataDecoder() {
+  clear();
+  errors = 0;
+}
+
+/**
+ * @fn void MtkDataDecoder::clear()
+ * @brief Discard the reply being decoded and wait for the next sentence.
+ */
+void MtkDataDecoder::clear() {
+  state = DS_IDLE;
+  headerPos = 0;
+  address = 0;
+  length = 0;
+  highNibble = 0;
+  hasHighNibble = false;
+  calcChecksum = 0;
+  recvChecksum = 0;
+  checksumDigits = 0;
+}
+
+/**
+ * @fn void MtkDataDecoder::begin()
+ * @brief Start decoding a new sentence (called when '$' is received).
+ */
+void MtkDataDecoder::begin() {
+  clear();
+  state = DS_HEADER;
+}
+
+/**
+ * @fn void MtkDataDecoder::abandon()
+ * @brief Drop the data reply being decoded (truncated or broken) and count it as an error.
+ */
+void MtkDataDecoder::abandon() {
+  state = DS_IDLE;
+  errors += 1;
+}
+
+/**
+ * @fn bool MtkDataDecoder::put(char ch)
+ * @brief Put a received character to the decoder.
+ * @param ch A character received from the logger.
+ * @return Returns true if a data reply is completed and its checksum is valid (the block is committed), otherwise
+ * false. Sentences other than the data reply are ignored.
+ */
+bool MtkDataDecoder::put(char ch) {
+  // a new sentence always restarts the decoder
+  if (ch == '$') {
+    if (state >= DS_ADDRESS) errors += 1;  // the data reply being decoded is truncated
+    begin();
+    return false;
+  }
+
+  uint8_t val = 0;
+
+  switch (state) {
+  case DS_IDLE:
+    break;
+
+  case DS_HEADER:
+    // compare with the prefix of the data reply. ignore the sentence if it is not a data reply
+    if (ch != HEADER[headerPos]) {
+      state = DS_IDLE;
+      break;
+    }
+
+    calcChecksum ^= (uint8_t)ch;
+    headerPos += 1;
+    if (HEADER[headerPos] == 0) state = DS_ADDRESS;
+    break;
+
+  case DS_ADDRESS:
+    calcChecksum ^= (uint8_t)ch;
+    if (ch == ',') {
+      state = DS_DATA;
+      break;
+    }
+
+    if ((val = HexDecoder::value(ch)) == HEX_INVALID) {
+      abandon();
+      break;
+    }
+    address = (address << 4) + val;
+    break;
+
+  case DS_DATA:
+    // the data column ends with '*' (it must be an even number of digits)
+    if (ch == '*') {
+      if (hasHighNibble) {
+        abandon();
+      } else {
+        state = DS_CHECKSUM;
+      }
+      break;
+    }
+
+    calcChecksum ^= (uint8_t)ch;
+    if ((val = HexDecoder::value(ch)) == HEX_INVALID) {
+      abandon();
+      break;
+    }
+
+    // decode a byte from each pair of the digits into the block
+    if (!hasHighNibble) {
+      highNibble = val;
+      hasHighNibble = true;
+    } else if (length < DD_BLOCK_SIZE) {
+      block[length] = (highNibble << 4) + val;
+      length += 1;
+      hasHighNibble = false;
+    } else {
+      abandon();  // too long
+    }
+    break;
+
+  case DS_CHECKSUM:
+    if ((val = HexDecoder::value(ch)) == HEX_INVALID) {
+      abandon();
+      break;
+    }
+
+    // commit the block when the two digits of the checksum are received and matched
+    recvChecksum = (recvChecksum << 4) + val;
+    checksumDigits += 1;
+    if (checksumDigits == 2) {
+      state = DS_IDLE;
+      if (recvChecksum != calcChecksum) errors += 1;
+      return ((recvChecksum == calcChecksum) && (length > 0));
+    }
+    break;
+  }
+
+  return false;
+}
+
+/**
+ * @fn bool MtkDataDecoder::put(const char *chars, uint16_t len, uint16_t *used)
+ * @brief Put a chunk of received characters to the decoder. The runs of hex digits in the data column are decoded by
+ * the table-driven kernel several characters at a time, and the other characters are put one by one.
+ * @param chars A pointer to the received characters.
+ * @param len The number of the characters.
+ * @param used A pointer to the variable to store the number of the characters consumed. The decoder stops right after
+ * a block is committed, so the rest of the chunk should be put again after the block is processed.
+ * @return Returns true if a data reply is completed and its checksum is valid (the block is committed), otherwise
+ * false.
+ */
+bool MtkDataDecoder::put(const char *chars, uint16_t len, uint16_t *used) {
+  uint16_t i = 0;
+
+  while (i < len) {
+    // decode the run of the hex digits at once (in the data column and at a byte boundary)
+    if ((state == DS_DATA) && (!hasHighNibble)) {
+      uint16_t room = (DD_BLOCK_SIZE - length) * 2;
+      uint16_t n = ((len - i) < room) ? (len - i) : room;
+
+      n = HexDecoder::decode((chars + i), n, (block + length));
+      calcChecksum ^= HexDecoder::checksum((chars + i), n);
+      length += (n / 2);
+      i += n;
+
+      if (i >= len) break;
+    }
+
+    // put the other characters (delimiters, address, checksum and an odd digit at the end of the chunk)
+    if (put(chars[i++])) {
+      *used = i;
+      return true;
+    }
+  }
+
+  *used = i;
+  return false;
+}
+
+/**
+ * @fn uint32_t MtkDataDecoder::getAddress()
+ * @brief Get the start address of the last committed block.
+ * @return Returns the address in the flash memory of the logger.
+ */
+uint32_t MtkDataDecoder::getAddress() {
+  return address;
+}
+
+/**
+ * @fn const uint8_t *MtkDataDecoder::getData()
+ * @brief Get the data of the last committed block. The data is valid until the next character is put.
+ * @return Returns a pointer to the block.
+ */
+const uint8_t *MtkDataDecoder::getData() {
+  return block;
+}
+
+/**
+ * @fn uint16_t MtkDataDecoder::getLength()
+ * @brief Get the length of the last committed block.
+ * @return Returns the length in bytes.
+ */
+uint16_t MtkDataDecoder::getLength() {
+  return length;
+}
+
+/**
+ * @fn uint32_t MtkDataDecoder::getErrors()
+ * @brief Get the number of the data replies dropped because they are truncated or broken (checksum error).
+ * @return Returns the number of the errors since the decoder is created.
+ */
+uint32_t MtkDataDecoder::getErrors() {
+  return errors;
+}
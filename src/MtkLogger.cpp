@@ -3,18 +3,38 @@
 #define PROGRESS_STARTED 0
 #define PROGRESS_FINISHED 100
 
+TaskHandle_t MtkLogger::rxWaiter = NULL;
+MtkLogger *MtkLogger::rxOwner = NULL;
+esp_spp_cb_t MtkLogger::appCallback = NULL;
+
 /**
- * @fn MtkLogger::MtkLogger(const char *devname)
+ * @fn MtkLogger::MtkLogger(const char *devname, uint32_t rxRingSize)
  * @brief Constructor of the MtkLogger class. Initialize the member variables and allocate the resources.
  * @param devname Name of the device for Bluetooth connection (default: "ESP32"; any name is acceptable).
+ * @param rxRingSize Size of the ring buffer to receive the data from the logger (rounded up to a power of 2).
  */
-MtkLogger::MtkLogger(const char *devname) {
+MtkLogger::MtkLogger(const char *devname, uint32_t rxRingSize) {
   deviceName = (devname == NULL) ? "ESP32" : devname;
   memset(&address, 0, sizeof(address));
 
   gpsSerial = new BluetoothSerial();
   buffer = new NmeaBuffer();
+  decoder = new MtkDataDecoder();
   sppStarted = false;
+  reqWindow = DEFAULT_REQ_WINDOW;
+  memset(replyHandlers, 0, sizeof(replyHandlers));
+  memset(&dlStats, 0, sizeof(dlStats));
+  captureFile = NULL;
+  captureStartAt = 0;
+  eventCallback = NULL;
+  rxPos = 0;
+  rxLen = 0;
+
+  // receive the SPP events to wake up the task waiting for the data (the app's callback is called from it)
+  gpsSerial->register_callback(&sppCallback);
+
+  // the ring buffer of each instance is filled by the SPP data callback while the instance is connected (rxOwner)
+  rxRing = new RxRingBuffer(rxRingSize);
 
   // App may be crashed if gpsSerial.begin() is called in the constructor
   // (probably because of M5stack is not ready yet)
@@ -31,8 +51,87 @@ MtkLogger::~MtkLogger() {
     disconnect();
     gpsSerial->end();
   }
+  if (rxOwner == this) rxOwner = NULL;
 
+  delete decoder;
+  delete buffer;
   delete gpsSerial;
+  delete rxRing;
+}
+
+/**
+ * @fn bool MtkLogger::matchName(const char *name, const char *pattern)
+ * @brief Check if a device name matches a pattern. The comparison ignores the case, and a pattern ending with '*'
+ * matches the names starting with the rest of the pattern.
+ * @param name The device name.
+ * @param pattern The device name or the name pattern.
+ * @return Returns true if the name matches the pattern, otherwise false.
+ */
+bool MtkLogger::matchName(const char *name, const char *pattern) {
+  size_t len = strlen(pattern);
+
+  if ((len > 0) && (pattern[len - 1] == '*')) {
+    return (strncasecmp(name, pattern, (len - 1)) == 0);
+  }
+
+  return (strcasecmp(name, pattern) == 0);
+}
+
+/**
+ * @fn int8_t MtkLogger::discover(const char **patterns, uint8_t count, uint8_t *addr, char *name, size_t nameLen,
+ * uint32_t timeout)
+ * @brief Discover the GPS logger by a single inquiry scan. All the devices found by the scan are matched against the
+ * table of the names at once, and the device matching the earliest entry of the table is taken.
+ * @param patterns A table of the device names or the name patterns (see matchName()) of the supported loggers.
+ * @param count The number of the entries of the table.
+ * @param addr A pointer to the buffer to store the address (6 bytes) of the found logger.
+ * @param name A pointer to the buffer to store the device name of the found logger.
+ * @param nameLen The size of the name buffer.
+ * @param timeout The duration of the inquiry scan in milliseconds.
+ * @return Returns the index of the matched table entry, or -1 if no supported logger is found.
+ */
+int8_t MtkLogger::discover(const char **patterns, uint8_t count, uint8_t *addr, char *name, size_t nameLen,
+                           uint32_t timeout) {
+  if (!sppStarted) {
+    sppStarted = gpsSerial->begin(deviceName, true);
+  } else if (connected()) {
+    disconnect();
+  }
+
+  if (eventCallback != NULL) {
+    eventCallback(ESP_SPP_INIT_EVT, NULL);
+  }
+
+  // run an inquiry scan and take the device matching the earliest entry of the table
+  int8_t found = -1;
+  BTScanResults *results = gpsSerial->discover(timeout);
+  int devCount = (results != NULL) ? results->getCount() : 0;
+
+  for (int i = 0; i < devCount; i++) {
+    BTAdvertisedDevice *dev = results->getDevice(i);
+    if ((dev == NULL) || (!dev->haveName())) continue;
+
+    String devName = dev->getName().c_str();
+    Serial.printf("Logger.discover: found %s (%s)\n", devName.c_str(), dev->getAddress().toString().c_str());
+
+    uint8_t limit = (found < 0) ? count : found;
+    for (uint8_t j = 0; j < limit; j++) {
+      if (!matchName(devName.c_str(), patterns[j])) continue;
+
+      found = j;
+      memcpy(addr, dev->getAddress().getNative(), 6);
+      strncpy(name, devName.c_str(), (nameLen - 1));
+      name[nameLen - 1] = '\0';
+      break;
+    }
+  }
+  gpsSerial->discoverClear();
+
+  if (eventCallback != NULL) {
+    eventCallback(ESP_SPP_UNINIT_EVT, NULL);
+  }
+
+  return found;
 }
 
 /**
@@ -49,7 +148,13 @@ bool MtkLogger::connect(String name) {
     disconnect();
   }
 
-  Serial.printf("Logger.connect: connect to %s\n", name);
+  // receive the data into the own ring buffer instead of the RX queue of BluetoothSerial
+  // (its RX queue is too small for the data replies unless the library is patched)
+  // Note: set it here, not in the constructor (the callback object may not be initialized yet)
+  rxOwner = this;
+  gpsSerial->onData(&sppDataCallback);
+
+  Serial.printf("Logger.connect: connect to %s\n", name.c_str());
 
   gpsSerial->setTimeout(1000);
   gpsSerial->setPin("0000");
@@ -81,9 +186,15 @@ bool MtkLogger::connect(uint8_t *addr) {
     disconnect();
   }
 
+  // receive the data into the own ring buffer instead of the RX queue of BluetoothSerial
+  // (its RX queue is too small for the data replies unless the library is patched)
+  // Note: set it here, not in the constructor (the callback object may not be initialized yet)
+  rxOwner = this;
+  gpsSerial->onData(&sppDataCallback);
+
   Serial.printf(
       "Logger.connect: "
-      "connect to logger %02X%02X-%02X%02X-%02X%02X%\n",
+      "connect to logger %02X%02X-%02X%02X-%02X%02X\n",
       addr[0], addr[1], addr[2], addr[3], addr[4], addr[5]);
 
   // register event callback function
@@ -123,6 +234,10 @@ void MtkLogger::disconnect() {
 
   gpsSerial->disconnect();
   buffer->clear();
+  decoder->clear();
+  rxPos = 0;
+  rxLen = 0;
+  rxRing->clear();
 
   if (eventCallback != NULL) {
     eventCallback(ESP_SPP_UNINIT_EVT, NULL);
@@ -175,6 +290,57 @@ int32_t MtkLogger::firmwareIdToFlashSize(uint16_t firmwareId) {
   return flashSize;
 }
 
+/**
+ * @fn uint16_t MtkLogger::scanDataEnd(const uint8_t *data, uint16_t len, bool *dataEnd)
+ * @brief Scan a downloaded block for the end of the log data (0x200 continuous 0xFFs). The block is checked four bytes
+ * at a time: a word of all 0xFFs extends the run, and a word without any 0xFF breaks it. Only the words mixing both
+ * are checked a byte at a time.
+ * @param data A pointer to the block.
+ * @param len The length of the block.
+ * @param dataEnd A pointer to the flag set true if the end of the log data is found.
+ * @return Returns the length of the data to be written (up to the byte which ends the log data).
+ */
+uint16_t MtkLogger::scanDataEnd(const uint8_t *data, uint16_t len, bool *dataEnd) {
+  uint16_t ffCount = 0;  // counter for how many 0xFFs are continuous
+  uint16_t i = 0;
+
+  while (i < len) {
+    if ((i + 4) <= len) {
+      uint32_t w;
+      memcpy(&w, (data + i), sizeof(w));  // data may be unaligned
+
+      // all four bytes are 0xFF: extend the run
+      if (w == 0xFFFFFFFF) {
+        if ((ffCount + 4) >= SIZE_HEADER) {
+          *dataEnd = true;
+          return (i + (SIZE_HEADER - ffCount));
+        }
+        ffCount += 4;
+        i += 4;
+        continue;
+      }
+
+      // none of four bytes is 0xFF (no zero byte in ~w): the run is broken
+      uint32_t nw = ~w;
+      if (((nw - 0x01010101) & w & 0x80808080) == 0) {
+        ffCount = 0;
+        i += 4;
+        continue;
+      }
+    }
+
+    // otherwise check a byte at a time
+    ffCount = (data[i] != 0xFF) ? 0 : (ffCount + 1);
+    i += 1;
+    if (ffCount >= SIZE_HEADER) {
+      *dataEnd = true;
+      return i;
+    }
+  }
+
+  return len;
+}
+
 /**
  * @fn uint8_t MtkLogger::calcNmeaChecksum(const char *cmd)
  * @brief Calculate the checksum of the given NMEA command string. The checksum is calculated by XORing all bytes of the
@@ -217,6 +383,7 @@ bool MtkLogger::sendNmeaCommand(const char *cmd) {
 
   // print the debug message
   Serial.printf("Logger.send: -> %s\n", sendbuf);
+  if (captureFile != NULL) capture(CAPTURE_TX, sendbuf, strlen(sendbuf));
 
   return true;
 }
@@ -236,6 +403,9 @@ bool MtkLogger::waitForNmeaReply(const char *reply, uint16_t timeout) {
 
   if (timeout == 0) timeout = MSG_TIMEOUT;  // default timeout is MSG_TIMEOUT
 
+  // classify the expected reply once. only the sentences of the same type are compared with it
+  nmeatype_t replyType = NmeaClassifier::classify(reply);
+
   // set the timeout period
   uint32_t timeStartAt = millis();
 
@@ -248,21 +418,262 @@ bool MtkLogger::waitForNmeaReply(const char *reply, uint16_t timeout) {
       return false;
     }
 
-    // read charactor until get a NMEA sentence
-    if (!gpsSerial->available()) continue;
-    if (!buffer->put(gpsSerial->read())) continue;
+    // receive a chunk of charactors (or sleep until any data arrives)
+    if (!receive(timeout - timeElapsed)) continue;
+
+    // put charactors until get a NMEA sentence.
+    // the rest of the chunk is kept for the next call
+    while (rxPos < rxLen) {
+      if (!buffer->put(rxBuf[rxPos++])) continue;
+
+      // exit loop (and return true) if the expected response is detected
+      if (((replyType == NMEA_PENDING) || (buffer->getType() == replyType)) && (buffer->match(reply))) {
+        // put debug message
+        Serial.printf("Logger.recv: <- %.64s\n", buffer->getBuffer());
 
-    // exit loop (and return true) if the expected response is detected
-    if (buffer->match(reply)) {
+        return true;
+      }
+
+      // route the other sentences to the handler registered for the type
+      dispatchReply();
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @fn bool MtkLogger::sendNmeaBatch(nmeaquery_t *queries, uint8_t count, uint16_t timeout)
+ * @brief Send a batch of NMEA commands back to back, then wait for their replies. Each reply is dispatched to the
+ * handler of the first query that is waiting for a reply with the matching prefix (the logger replies in order, so the
+ * queries with the same reply prefix are answered in the order they are sent). The batch costs one round trip of
+ * latency instead of one for each command. The ACKs of the queries that are not waited for are ignored.
+ * @param queries An array of the queries.
+ * @param count The number of the queries (up to MAX_BATCH_SIZE).
+ * @param timeout The timeout period for the whole batch in milliseconds.
+ * @return Returns true if the replies of all queries are received within the timeout period, otherwise false.
+ */
+bool MtkLogger::sendNmeaBatch(nmeaquery_t *queries, uint8_t count, uint16_t timeout) {
+  // return false if the GPS logger is not connected
+  if (!connected()) return false;
+  if ((count == 0) || (count > MAX_BATCH_SIZE)) return false;
+
+  if (timeout == 0) timeout = MSG_TIMEOUT;  // default timeout is MSG_TIMEOUT
+
+  // send all the commands without waiting for the replies
+  for (uint8_t i = 0; i < count; i++) {
+    if (!sendNmeaCommand(queries[i].command)) return false;
+  }
+
+  // classify the expected replies once. only the sentences of the same type are compared with them
+  nmeatype_t replyTypes[MAX_BATCH_SIZE];
+  for (uint8_t i = 0; i < count; i++) replyTypes[i] = NmeaClassifier::classify(queries[i].reply);
+
+  // set the timeout period
+  uint32_t pending = (count == 32) ? 0xFFFFFFFF : ((1UL << count) - 1);
+  uint32_t timeStartAt = millis();
+
+  // wait for the replies from the GPS logger
+  while ((gpsSerial->connected()) && (pending != 0)) {
+    // exit loop if the timeout reached
+    uint32_t timeElapsed = millis() - timeStartAt;
+    if (timeElapsed > timeout) {
+      Serial.printf("Logger.recv: ** timeout occured (pending=0x%08X) **\n", pending);
+      return false;
+    }
+
+    // receive a chunk of charactors (or sleep until any data arrives)
+    if (!receive(timeout - timeElapsed)) continue;
+
+    // put charactors until get a NMEA sentence, then dispatch it to the first query waiting for it
+    while ((rxPos < rxLen) && (pending != 0)) {
+      if (!buffer->put(rxBuf[rxPos++])) continue;
+
+      uint8_t i = 0;
+      for (i = 0; i < count; i++) {
+        if (!(pending & (1UL << i))) continue;
+        if ((replyTypes[i] != NMEA_PENDING) && (buffer->getType() != replyTypes[i])) continue;
+        if (!buffer->match(queries[i].reply)) continue;
+
+        // put debug message
+        Serial.printf("Logger.recv: <- %.64s\n", buffer->getBuffer());
+
+        if (queries[i].handler) queries[i].handler(buffer, queries[i].param);
+        pending &= ~(1UL << i);
+        break;
+      }
+
+      // route the other sentences to the handler registered for the type
+      if (i >= count) dispatchReply();
+    }
+  }
+
+  return (pending == 0);
+}
+
+/**
+ * @fn void MtkLogger::dispatchReply()
+ * @brief Route the sentence in the buffer (not waited for) to the handler registered for its type.
+ */
+void MtkLogger::dispatchReply() {
+  nmeatype_t type = buffer->getType();
+
+  if ((type < NMEA_TYPES) && (replyHandlers[type] != NULL)) replyHandlers[type](buffer);
+}
+
+/**
+ * @fn void MtkLogger::setReplyHandler(nmeatype_t type, void (*handler)(NmeaBuffer *))
+ * @brief Register the handler for the sentences of the given type that are received while waiting for other replies
+ * (for example, the system messages of the logger).
+ * @param type The type of the sentences.
+ * @param handler A pointer to the handler function, or NULL to unregister.
+ */
+void MtkLogger::setReplyHandler(nmeatype_t type, void (*handler)(NmeaBuffer *)) {
+  if (type < NMEA_TYPES) replyHandlers[type] = handler;
+}
+
+/**
+ * @fn void MtkLogger::readDecValue(NmeaBuffer *reply, void *value)
+ * @brief A query handler to read the 4th column of the reply as a decimal value.
+ * @param reply A pointer to the buffer containing the reply.
+ * @param value A pointer to the int32_t variable to store the value.
+ */
+void MtkLogger::readDecValue(NmeaBuffer *reply, void *value) {
+  reply->readColumnAsInt(3, (int32_t *)value, false);
+}
+
+/**
+ * @fn bool MtkLogger::waitForDataReply(uint16_t timeout)
+ * @brief Wait for a data reply ("$PMTK182,8,") from the GPS logger. The received characters are decoded by the data
+ * decoder as they arrive (not stored in the NMEA buffer), and the other sentences are ignored.
+ * @param timeout A uint16_t value that contains the timeout period in milliseconds.
+ * @return Returns true if a data reply with the valid checksum is received within the timeout period, otherwise false.
+ * The address and the data of the reply can be obtained from the decoder.
+ */
+bool MtkLogger::waitForDataReply(uint16_t timeout) {
+  // return false if the GPS logger is not connected
+  if (!connected()) return false;
+
+  if (timeout == 0) timeout = MSG_TIMEOUT;  // default timeout is MSG_TIMEOUT
+
+  // set the timeout period
+  uint32_t timeStartAt = millis();
+
+  // wait for the reply from the GPS logger
+  while (gpsSerial->connected()) {
+    // exit loop if the timeout reached
+    uint32_t timeElapsed = millis() - timeStartAt;
+    if (timeElapsed > timeout) {
+      Serial.printf("Logger.recv: ** timeout occured **\n");
+      return false;
+    }
+
+    // receive a chunk of charactors (or sleep until any data arrives)
+    if (!receive(timeout - timeElapsed)) continue;
+
+    // decode the chunk until a data reply is committed.
+    // the rest of the chunk is kept for the next call
+    uint16_t used = 0;
+    bool committed = decoder->put((const char *)(rxBuf + rxPos), (rxLen - rxPos), &used);
+    rxPos += used;
+
+    if (committed) {
       // put debug message
-      Serial.printf("Logger.recv: <- %.64s\n", buffer->getBuffer());
+      Serial.printf("Logger.recv: <- $PMTK182,8,%08X (%d bytes)\n", decoder->getAddress(), decoder->getLength());
 
-      break;
+      return true;
     }
   }
 
-  // return true if the expected reply is received
-  return true;
+  return false;
+}
+
+/**
+ * @fn bool MtkLogger::receive(uint32_t timeout)
+ * @brief Make the received charactors available in rxBuf. If no charactor is left in rxBuf, take the charactors
+ * received in the ring buffer at once. If nothing is received yet, the task sleeps until the SPP callback notifies an event or
+ * the timeout period elapses (instead of polling the serial).
+ * @param timeout The max period to sleep in milliseconds.
+ * @return Returns true if any charactor is available in rxBuf, otherwise false.
+ */
+bool MtkLogger::receive(uint32_t timeout) {
+  if (rxPos < rxLen) return true;
+  rxPos = 0;
+  rxLen = 0;
+
+  // register this task as the waiter and clear the pending notification before checking the ring,
+  // so that the data arriving after the check always wakes up this task
+  rxWaiter = xTaskGetCurrentTaskHandle();
+  ulTaskNotifyTake(pdTRUE, 0);
+
+  if (rxRing->available() == 0) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout));
+  }
+  rxWaiter = NULL;
+
+  // take the received charactors at once
+  rxLen = rxRing->pop(rxBuf, RX_CHUNK_SIZE);
+  if ((captureFile != NULL) && (rxLen > 0)) capture(CAPTURE_RX, rxBuf, rxLen);
+
+  return (rxLen > 0);
+}
+
+/**
+ * @fn void MtkLogger::capture(capturedir_t dir, const void *data, uint16_t len)
+ * @brief Write the sent or received characters with the time to the capture file.
+ * @param dir The direction of the characters.
+ * @param data A pointer to the characters.
+ * @param len The number of the characters.
+ */
+void MtkLogger::capture(capturedir_t dir, const void *data, uint16_t len) {
+  capturerecord_t rcd = {(millis() - captureStartAt), len, (uint8_t)dir, 0};
+
+  captureFile->write(&rcd, sizeof(rcd));
+  captureFile->write(data, len);
+}
+
+/**
+ * @fn void MtkLogger::setCaptureFile(File32 *capture)
+ * @brief Start or stop capturing the raw SPP session. While capturing, the characters sent to and received from the
+ * logger are written to the file as records (capturerecord_t followed by the characters) after a magic string.
+ * The capture can be replayed by tools/replay-host (or tools/mtk-logger-sim.py over a pseudo terminal).
+ * @param capture A pointer to the capture file object (opened and empty), or NULL to stop capturing.
+ */
+void MtkLogger::setCaptureFile(File32 *capture) {
+  if (captureFile != NULL) captureFile->flush();
+
+  captureFile = capture;
+  captureStartAt = millis();
+  if (captureFile != NULL) captureFile->write(CAPTURE_MAGIC, strlen(CAPTURE_MAGIC));
+}
+
+/**
+ * @fn void MtkLogger::sppCallback(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
+ * @brief The SPP event handler registered to the BluetoothSerial. Wake up the task waiting in receive() on any event
+ * (data arrival or disconnection), then forward the event to the callback set by setEventCallback().
+ * @param event The SPP event.
+ * @param param The parameter of the event.
+ */
+void MtkLogger::sppCallback(esp_spp_cb_event_t event, esp_spp_cb_param_t *param) {
+  TaskHandle_t waiter = rxWaiter;
+  if (waiter != NULL) xTaskNotifyGive(waiter);
+
+  if (appCallback != NULL) appCallback(event, param);
+}
+
+/**
+ * @fn void MtkLogger::sppDataCallback(const uint8_t *data, size_t len)
+ * @brief The SPP data handler registered to the BluetoothSerial (called in the Bluetooth task). Put the received data
+ * into the ring buffer of the instance connected last and wake up the task waiting in receive().
+ * @param data A pointer to the received data.
+ * @param len The length of the received data.
+ */
+void MtkLogger::sppDataCallback(const uint8_t *data, size_t len) {
+  MtkLogger *owner = rxOwner;
+  if (owner != NULL) owner->rxRing->push(data, len);
+
+  TaskHandle_t waiter = rxWaiter;
+  if (waiter != NULL) xTaskNotifyGive(waiter);
 }
 
 /**
@@ -279,6 +690,7 @@ bool MtkLogger::sendDownloadCommand(int startPos, int reqSize) {
   char cmdstr[32];
   sprintf(cmdstr, "PMTK182,7,%06X,%04X", startPos, reqSize);
 
+  dlStats.requests += 1;
   return sendNmeaCommand(cmdstr);
 }
 
@@ -321,198 +733,906 @@ bool MtkLogger::getLastRecordAddress(int32_t *address) {
 }
 
 /**
- * @fn bool MtkLogger::resetCache(File32 *cache)
- * @brief Determine the resume position of the download process. The resume position is determined in units of data
- * sectors (multiple of 65536 bytes). If the cache file is invalid, the file is truncated and the function returns 0.
- * @param cache A pointer to the cache file object to store the downloaded data.
- * @return Returns the resume position of the download process in bytes. The content after the resume position in
- * the cache file is automatically truncated.
+ * @fn bool MtkLogger::getDownloadEnd(int32_t reqSize, int32_t *endAddr)
+ * @brief Get the end address of the download. In FULLSTOP mode, the last record address is rounded up to the request
+ * size. In OVERWRITE mode, the last record address is already the flash size. In both modes, the address is clamped
+ * to the flash size so that no sector beyond the end of the flash is requested.
+ * @param reqSize The request size to round up the address to.
+ * @param endAddr A pointer to the variable to store the end address.
+ * @return Returns true if the address is obtained, otherwise false.
  */
-int32_t MtkLogger::resetCache(File32 *cache) {
-  const uint32_t CHECK_LEN = 0x200;
-  uint32_t binFileSize = cache->fileSize();
+bool MtkLogger::getDownloadEnd(int32_t reqSize, int32_t *endAddr) {
+  int32_t flashSize = 0;
 
-  // Truncate the cache file if the file size is less than a sector size
-  if (binFileSize < SIZE_SECTOR) {
-    cache->truncate(0);
-    return 0;
+  if (!getLastRecordAddress(endAddr)) return false;
+  if (!getFlashSize(&flashSize)) return false;
+
+  if (*endAddr < flashSize) *endAddr = reqSize * ((*endAddr / reqSize) + 1);
+  if (*endAddr > flashSize) *endAddr = flashSize;
+
+  return true;
+}
+
+/**
+ * @fn uint32_t MtkLogger::fnv1a(uint32_t hash, const uint8_t *data, size_t len)
+ * @brief Update the FNV-1a hash (32-bit) with the given data.
+ * @param hash The current hash value (FNV_INIT for the first data).
+ * @param data A pointer to the data.
+ * @param len The length of the data.
+ * @return Returns the updated hash value.
+ */
+uint32_t MtkLogger::fnv1a(uint32_t hash, const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ data[i]) * 16777619UL;
   }
 
-  if (!sendDownloadCommand(0, SIZE_REPLY)) return -1;
-  if (!waitForNmeaReply("$PMTK182,8,", 3000)) return -1;
+  return hash;
+}
+
+/**
+ * @fn void MtkLogger::initCacheIndex(File32 *index)
+ * @brief Initialize the cache index file with the header and the empty entries for all sectors.
+ * @param index A pointer to the index file object.
+ */
+void MtkLogger::initCacheIndex(File32 *index) {
+  cacheindexhdr_t hdr;
+  cacheindexent_t ent;
+
+  memcpy(hdr.magic, CACHE_INDEX_MAGIC, sizeof(hdr.magic));
+  hdr.sectorSize = SIZE_SECTOR;
+  hdr.sectorCount = MAX_SECTORS;
+  memset(&ent, 0, sizeof(ent));
+
+  index->truncate(0);
+  index->write(&hdr, sizeof(hdr));
+  for (uint16_t i = 0; i < MAX_SECTORS; i++) index->write(&ent, sizeof(ent));
+  index->flush();
+}
+
+/**
+ * @fn void MtkLogger::writeCacheIndex(File32 *index, uint16_t sector, uint32_t headHash, uint32_t sectorHash)
+ * @brief Write the hashes of a sector to the cache index file. Writing zeros invalidates the entry.
+ * @param index A pointer to the index file object (do nothing if NULL).
+ * @param sector The sector number.
+ * @param headHash The hash of the first block (0x800 bytes) of the sector.
+ * @param sectorHash The hash of the whole sector.
+ */
+void MtkLogger::writeCacheIndex(File32 *index, uint16_t sector, uint32_t headHash, uint32_t sectorHash) {
+  if ((index == NULL) || (sector >= MAX_SECTORS)) return;
+
+  cacheindexent_t ent = {headHash, sectorHash};
+  index->seek(sizeof(cacheindexhdr_t) + (sector * sizeof(cacheindexent_t)));
+  index->write(&ent, sizeof(ent));
+}
+
+/**
+ * @fn bool MtkLogger::probeSectors(int32_t endAddr, uint64_t *written, uint64_t *opened, uint32_t *headHashes)
+ * @brief Read the first block (the header and the first records) of each sector up to the given address to build a
+ * map of the written sectors. A sector whose header is filled with 0xFF has never been written, and a written sector
+ * whose record count is 0xFFFF is being written (the count is set when the sector is full). The requests are
+ * pipelined in the same way as the download.
+ * @param endAddr The last address to download.
+ * @param written A pointer to the bitmap to store the written sectors (bit n is set if sector n is written).
+ * @param opened A pointer to the bitmap to store the sectors being written.
+ * @param headHashes An array (MAX_SECTORS entries) to store the hashes of the first block of each sector.
+ * @return Returns true if all sectors are probed successfully, otherwise false.
+ */
+bool MtkLogger::probeSectors(int32_t endAddr, uint64_t *written, uint64_t *opened, uint32_t *headHashes) {
+  const int8_t MAX_RETRIES = 3;
 
-  cache->seekCur(SIZE_HEADER);
-  buffer->seekCurToColumn(3);  // move to the 4th column (data column)
-  buffer->seekCur(SIZE_HEADER * 2);
+  uint16_t sectors = ((endAddr + (SIZE_SECTOR - 1)) / SIZE_SECTOR);
+  uint16_t nextSector = 0;  // the sector to receive next
+  uint16_t reqSector = 0;   // the sector to request next (sectors before this are in flight)
+  int8_t retries = 0;
 
-  // Check the first 0x200 bytes of the cache file is the same as the received data.
-  // If they are the same, the cache file is valid and can be used to resume the download.
-  bool canResume = true;
-  char fbuf[CHECK_LEN];
-  cache->readBytes(fbuf, sizeof(fbuf));
-  for (int16_t i = 0; i < sizeof(fbuf) - 1; i++) {
-    byte dlby;
-    buffer->readHexByteFull(&dlby);
-    canResume &= (fbuf[i] == (char)dlby);
+  if (sectors > MAX_SECTORS) sectors = MAX_SECTORS;
+  *written = 0;
+  *opened = 0;
+
+  while ((gpsSerial->connected()) && (nextSector < sectors)) {
+    // fill the window with the requests of the header blocks
+    while ((reqSector < sectors) && ((reqSector - nextSector) < reqWindow)) {
+      if (!sendDownloadCommand(reqSector * SIZE_SECTOR, SIZE_REPLY)) return false;
+      reqSector++;
+    }
+
+    // request again from the next sector if the expected reply is NOT received
+    if (!waitForDataReply(linkStats.timeout1)) {
+      if (retries >= MAX_RETRIES) break;
+
+      reqSector = nextSector;
+      retries++;
+      continue;
+    }
+
+    // ignore the replies of the other sectors (late replies of the discarded requests)
+    if ((int32_t)decoder->getAddress() != (nextSector * SIZE_SECTOR)) continue;
+
+    // the sector is written if any byte of the header is not 0xFF
+    const uint8_t *data = decoder->getData();
+    for (uint16_t i = 0; i < SIZE_HEADER; i += sizeof(uint32_t)) {
+      if (*(uint32_t *)(data + i) != 0xFFFFFFFF) {
+        *written |= (1ULL << nextSector);
+        break;
+      }
+    }
+    if ((*written & (1ULL << nextSector)) && (*(uint16_t *)data == 0xFFFF)) *opened |= (1ULL << nextSector);
+    headHashes[nextSector] = fnv1a(FNV_INIT, data, decoder->getLength());
+
+    nextSector++;
+    retries = 0;
   }
 
-  // Wait for the ACK responce of the download command
-  waitForNmeaReply("$PMTK001,", ACK_TIMEOUT);
+  Serial.printf("Logger.probeSectors: written=0x%016llX, opened=0x%016llX (%d sectors)\n",
+                (unsigned long long)*written, (unsigned long long)*opened, sectors);
+
+  return (nextSector >= sectors);
+}
+
+/**
+ * @fn bool MtkLogger::hashCacheBlock(File32 *cache, int32_t addr, uint32_t *hash)
+ * @brief Calculate the hash of a block (0x800 bytes) in the cache file.
+ * @param cache A pointer to the cache file object.
+ * @param addr The start address of the block.
+ * @param hash A pointer to store the hash of the block.
+ * @return Returns true if the whole block is read, otherwise false.
+ */
+bool MtkLogger::hashCacheBlock(File32 *cache, int32_t addr, uint32_t *hash) {
+  uint8_t fbuf[512];
+
+  *hash = FNV_INIT;
+  if (!cache->seek(addr)) return false;
+
+  for (int32_t pos = 0; pos < SIZE_REPLY; pos += sizeof(fbuf)) {
+    if (cache->read(fbuf, sizeof(fbuf)) != sizeof(fbuf)) return false;
+
+    *hash = fnv1a(*hash, fbuf, sizeof(fbuf));
+  }
+
+  return true;
+}
 
-  // If the cache file is not valid, truncate the file and return 0
-  if (!canResume) {
-    cache->truncate(0);
+/**
+ * @fn void MtkLogger::fillData(File32 *output, int32_t addr, int32_t endAddr)
+ * @brief Fill a range of the output file with 0xFF (an unwritten sector, or a gap left by the blocks not received
+ * yet).
+ * @param output A pointer to the output file object.
+ * @param addr The start address of the range (must not be beyond the end of the file).
+ * @param endAddr The end address of the range.
+ */
+void MtkLogger::fillData(File32 *output, int32_t addr, int32_t endAddr) {
+  uint8_t fbuf[512];
+
+  memset(fbuf, 0xFF, sizeof(fbuf));
+  output->seek(addr);
+  for (int32_t pos = addr; pos < endAddr; pos += sizeof(fbuf)) {
+    output->write(fbuf, ((endAddr - pos) < (int32_t)sizeof(fbuf)) ? (endAddr - pos) : sizeof(fbuf));
+  }
+}
+
+/**
+ * @fn bool MtkLogger::copyData(File32 *src, int32_t srcPos, File32 *dst, int32_t dstPos, int32_t size)
+ * @brief Copy a range of a file to another file.
+ * @param src A pointer to the source file object.
+ * @param srcPos The position of the range in the source file.
+ * @param dst A pointer to the destination file object.
+ * @param dstPos The position to write the range in the destination file (must not be beyond the end of the file).
+ * @param size The size of the range.
+ * @return Returns true if the whole range is copied, otherwise false.
+ */
+bool MtkLogger::copyData(File32 *src, int32_t srcPos, File32 *dst, int32_t dstPos, int32_t size) {
+  uint8_t fbuf[512];
+
+  if ((!src->seek(srcPos)) || (!dst->seek(dstPos))) return false;
+
+  for (int32_t pos = 0; pos < size; pos += sizeof(fbuf)) {
+    int32_t len = ((size - pos) < (int32_t)sizeof(fbuf)) ? (size - pos) : sizeof(fbuf);
+    if (src->read(fbuf, len) != len) return false;
+    if (dst->write(fbuf, len) != (size_t)len) return false;
+  }
+
+  return true;
+}
+
+/**
+ * @fn uint64_t MtkLogger::verifyCache(File32 *cache, File32 *index, int32_t endAddr, const uint32_t *headHashes)
+ * @brief Determine the sectors in the cache file that can be reused. A sector is reused if (1) it is recorded in the
+ * index, (2) it is full (its record count is not 0xFFFF; the sector being written may be appended later), (3) the
+ * first block of the cached sector matches the head hash in the index, and (4) the first block read from the logger
+ * by probeSectors() matches the head hash in the index (the sector has not been erased and rewritten).
+ * Only the first block of each sector is read from the cache (a full sector is not changed by the logger until it is
+ * rewritten, which changes its first block).
+ * @param cache A pointer to the cache file object.
+ * @param index A pointer to the index file object. If NULL is given, no sector is reused.
+ * @param endAddr The last address to download.
+ * @param headHashes The hashes of the first block of each sector read from the logger.
+ * @return Returns the bitmap of the reusable sectors (bit n is set if sector n is reused).
+ */
+uint64_t MtkLogger::verifyCache(File32 *cache, File32 *index, int32_t endAddr, const uint32_t *headHashes) {
+  uint64_t reusable = 0;
+  uint16_t reused = 0;
+
+  if (index == NULL) return 0;
+
+  // initialize the index if it is not valid
+  cacheindexhdr_t hdr;
+  index->seek(0);
+  if ((index->read(&hdr, sizeof(hdr)) != sizeof(hdr)) ||
+      (memcmp(hdr.magic, CACHE_INDEX_MAGIC, sizeof(hdr.magic)) != 0) || (hdr.sectorSize != SIZE_SECTOR) ||
+      (hdr.sectorCount != MAX_SECTORS)) {
+    initCacheIndex(index);
     return 0;
   }
 
-  // Determine the resume position of the download.
-  // Check the number of records in each sector from the beginning, and if the value is 0xFFFF,
-  // and if the value is 0xFFFF, determine that downloading is necessary from that sector.
-  int32_t resumeAddr = 0;
-  while (resumeAddr < cache->fileSize()) {
-    cache->seek(resumeAddr);
-    uint16_t records = (cache->read() << 8) + (cache->read());
+  for (uint16_t sector = 0; sector < MAX_SECTORS; sector++) {
+    int32_t addr = sector * SIZE_SECTOR;
+    if (((addr + SIZE_SECTOR) > (int32_t)cache->fileSize()) || ((addr + SIZE_SECTOR) > endAddr)) break;
+
+    // (1) skip the sector not recorded in the index
+    cacheindexent_t ent;
+    index->seek(sizeof(cacheindexhdr_t) + (sector * sizeof(cacheindexent_t)));
+    if (index->read(&ent, sizeof(ent)) != sizeof(ent)) break;
+    if ((ent.headHash == 0) && (ent.sectorHash == 0)) continue;
+
+    // (2) skip the sector being written
+    uint16_t nos = 0xFFFF;
+    cache->seek(addr);
+    cache->read(&nos, sizeof(nos));
+    if (nos == 0xFFFF) continue;
 
-    if (records == 0xFFFF) break;
+    // (3) verify the first block of the cached sector with the head hash
+    uint32_t headHash;
+    if ((!hashCacheBlock(cache, addr, &headHash)) || (headHash != ent.headHash)) continue;
 
-    resumeAddr += SIZE_SECTOR;
+    // (4) compare the first block of the sector in the logger with the head hash
+    if (headHashes[sector] != ent.headHash) continue;
+
+    reusable |= (1ULL << sector);
+    reused += 1;
   }
 
-  Serial.printf("Logger.resetCache: using %d bytes of cache\n", resumeAddr);
+  Serial.printf("Logger.verifyCache: reusing %d sectors of cache\n", reused);
 
-  // Finally, truncate the content of the cache file after the resume position
-  cache->truncate(resumeAddr);
-  return resumeAddr;
+  return reusable;
 }
 
 /**
- * @fn book MtkLogger::downloadLogData(File32 *output, void (*progressCallback)(int32_t, int32_t))
+ * @fn book MtkLogger::downloadLogData(File32 *output, void (*progressCallback)(int32_t, int32_t), File32 *index)
  * @brief Download the log data from the GPS logger and store it in the given output / cache file.
+ * The header block of each sector is read first to find the written sectors. The unwritten sectors are not downloaded,
+ * the sectors verified by the cache index are reused, and only the other sectors are downloaded.
  * The callback function is called to notify the progress of the download process.
  * @param output A pointer to the output file object to store the downloaded log data.
  * @param progressCallback A pointer to the callback function that is called to notify the progress of the download
  * process. The function should have two int32_t arguments that contain the current position and the end position of the
  * download process.
+ * @param index A pointer to the file object to store the hashes of the downloaded sectors. If NULL is given, the cache
+ * is never reused.
  * @return Returns true if the download process is finished successfully, otherwise false.
  */
-bool MtkLogger::downloadLogData(File32 *output, void (*progressCallback)(int32_t, int32_t)) {
-  const int8_t MAX_RETRIES = 3;
+bool MtkLogger::downloadLogData(File32 *output, void (*progressCallback)(int32_t, int32_t), File32 *index) {
   const int32_t REQ_SIZE = 0x4000;
-  const int32_t LOG_TIMEOUT1 = 3000;
-  const int32_t LOG_TIMEOUT2 = 1000;
 
-  bool nextReq = true;
   bool dataEnd = false;
-  int32_t nextAddr = 0;  // the address of next data block to receive
-  int32_t recvSize = 0;  // received data size for the last request
-  int32_t endAddr = 0;   // the last address to download
-  int8_t retries = 0;    // retry count
-  int16_t timeout = LOG_TIMEOUT1;
+  bool result = true;
+  int32_t endAddr = 0;  // the last address to download
 
   Serial.printf("Logger.download: initalizing\n");
 
   // get the last address to be downloaded (endAddr).
-  // the address is the address of the last og data (STOP mode) or the flash size (OVERWRAP mode).
-  // this value will be used for calculating the download progress rate.
-  if (!getLastRecordAddress(&endAddr)) return false;
-  endAddr = REQ_SIZE * ((endAddr / REQ_SIZE) + 1);
-
-  // perform the callback to notify the download process is started
-  if (progressCallback) progressCallback(nextAddr, endAddr);
+  // the address is the address of the last og data (STOP mode) or the flash size (OVERWRAP mode), and never beyond
+  // the end of the flash. this value will be used for calculating the download progress rate.
+  if (!getDownloadEnd(REQ_SIZE, &endAddr)) return false;
 
-  if ((nextAddr = resetCache(output)) == -1) return false;
-  output->truncate(nextAddr);
+  // start with the initial request size and the conservative timeouts. they are adapted to the link quality
+  // measured during the download
+  resetLinkStats(REQ_SIZE);
+  resetDownloadStats();
 
   // perform the callback to notify the download process is started
   if (progressCallback) progressCallback(0, endAddr);
 
-  Serial.printf("Logger.download: start [start=0x%06X, end=0x%06X, resume=%d] (t=%d)\n",  //
-                nextAddr, endAddr, (nextAddr != 0), millis());
+  // read the header block of each sector to find the written sectors, then drop the unwritten sectors at the end
+  // (in OVERWRITE mode, the flash is not full until the logger wraps around)
+  uint64_t written = 0;
+  uint64_t opened = 0;
+  uint32_t headHashes[MAX_SECTORS];
+  if (!probeSectors(endAddr, &written, &opened, headHashes)) return false;
 
-  while (gpsSerial->connected()) {
-    // break if the download process is finished
-    if (nextAddr >= endAddr) {
-      // print the success message and
-      Serial.printf("Logger.download: finished [end=0x%06X] (t=%d)\n",  //
-                    endAddr, millis());
+  int32_t writtenEnd = 0;
+  for (uint16_t sector = 0; sector < MAX_SECTORS; sector++) {
+    if (written & (1ULL << sector)) writtenEnd = (sector + 1) * SIZE_SECTOR;
+  }
+  if (writtenEnd < endAddr) endAddr = writtenEnd;
+
+  // determine the sectors that can be reused. start from an empty file if nothing can be reused
+  uint64_t cached = verifyCache(output, index, endAddr, headHashes) & written;
+  if (cached == 0) output->truncate(0);
+
+  // pre-allocate a contiguous extent for the whole log data if the download starts from the beginning.
+  // this avoids allocating clusters and updating the FAT during the download (it only works for an empty file)
+  bool preAllocated = ((output->fileSize() == 0) && (output->preAllocate(endAddr)));
+  if (preAllocated) {
+    Serial.printf("Logger.download: pre-allocated %d bytes\n", endAddr);
+  }
+
+  Serial.printf("Logger.download: start [end=0x%06X, written=0x%016llX, cached=0x%016llX, window=%d] (t=%d)\n",  //
+                endAddr, (unsigned long long)written, (unsigned long long)cached, reqWindow, millis());
+
+  // download each run of the written sectors not cached. the unwritten sectors are filled with 0xFF locally
+  uint64_t download = (written & ~cached);
+  int32_t addr = 0;
+  while ((result) && (!dataEnd) && (addr < endAddr)) {
+    if (!(download & (1ULL << (addr / SIZE_SECTOR)))) {
+      if (!(cached & (1ULL << (addr / SIZE_SECTOR)))) {
+        fillData(output, addr, ((addr + SIZE_SECTOR) < endAddr) ? (addr + SIZE_SECTOR) : endAddr);
+        writeCacheIndex(index, (addr / SIZE_SECTOR), 0, 0);
+      }
+      addr += SIZE_SECTOR;
+      continue;
+    }
+
+    int32_t runEnd = addr;
+    while ((runEnd < endAddr) && (download & (1ULL << (runEnd / SIZE_SECTOR)))) runEnd += SIZE_SECTOR;
+    if (runEnd > endAddr) runEnd = endAddr;
+
+    result = downloadRange(output, index, addr, &runEnd, 0, endAddr, progressCallback, &dataEnd);
+    addr = runEnd;
+  }
+
+  if (result) {
+    // print the success message and
+    Serial.printf("Logger.download: finished [end=0x%06X] (t=%d)\n",  //
+                  addr, millis());
+  }
+
+  // print the summary of the download in one line
+  printDownloadSummary();
+
+  // drop the content after the end of the log data (and the unused part of the pre-allocated extent),
+  // close the output file, then clear the buffer
+  // Note: the replies of the requests still in flight are discarded by the next command or the disconnection
+  if ((dataEnd) || (preAllocated)) {
+    output->truncate(output->curPosition());
+  } else if ((int32_t)output->fileSize() > endAddr) {
+    output->truncate(endAddr);
+  }
+  output->flush();
+  if (index != NULL) index->flush();
+  buffer->clear();
+  decoder->clear();
+
+  // finally perform the callback to notify the progress is completed
+  if ((dataEnd) && (progressCallback)) progressCallback(addr, addr);
+
+  // return true if the download process is finished successfully
+  return result;
+}
+
+/**
+ * @fn bool MtkLogger::downloadLatestData(File32 *cache, File32 *output, void (*progressCallback)(int32_t, int32_t),
+ * File32 *index)
+ * @brief Download only the sector holding the newest log data and store it in the given output file. The newest
+ * sector is the sector being written (its record count is not set yet), or the last written sector if all sectors are
+ * full. The sector is downloaded directly into the output file to be converted alone (or copied from the cache if it
+ * is cached). It is also stored in the cache file at its address if the cache already reaches the sector, so the cache
+ * stays valid for the next full download.
+ * @param cache A pointer to the download cache file object (the same file given to downloadLogData()).
+ * @param output A pointer to the output file object to store the newest sector from the beginning.
+ * @param progressCallback A pointer to the progress callback function.
+ * @param index A pointer to the cache index file object (or NULL).
+ * @return Returns true if the newest sector is downloaded successfully (or there is no log data), otherwise false.
+ */
+bool MtkLogger::downloadLatestData(File32 *cache, File32 *output, void (*progressCallback)(int32_t, int32_t),
+                                   File32 *index) {
+  const int32_t REQ_SIZE = 0x4000;
+
+  bool dataEnd = false;
+  bool result = true;
+  int32_t endAddr = 0;
+
+  // get the last address of the log data and read the sector headers in the same way as downloadLogData()
+  if (!getDownloadEnd(REQ_SIZE, &endAddr)) return false;
+
+  resetLinkStats(REQ_SIZE);
+  resetDownloadStats();
+
+  uint64_t written = 0;
+  uint64_t opened = 0;
+  uint32_t headHashes[MAX_SECTORS];
+  if (!probeSectors(endAddr, &written, &opened, headHashes)) return false;
+
+  // find the newest sector. in OVERWRITE mode, the sector being written may be followed by the older sectors
+  int16_t newest = -1;
+  for (uint16_t sector = 0; sector < MAX_SECTORS; sector++) {
+    if (opened & (1ULL << sector)) {
+      newest = sector;
       break;
     }
+    if (written & (1ULL << sector)) newest = sector;
+  }
+
+  output->truncate(0);
+  if (newest < 0) {
+    Serial.printf("Logger.downloadLatest: no log data\n");
+    return true;
+  }
+
+  int32_t startAddr = newest * SIZE_SECTOR;
+  int32_t rangeEnd = ((startAddr + SIZE_SECTOR) < endAddr) ? (startAddr + SIZE_SECTOR) : endAddr;
+  Serial.printf("Logger.downloadLatest: start [sector=%d, addr=0x%06X-0x%06X] (t=%d)\n",  //
+                newest, startAddr, rangeEnd, millis());
+
+  if (progressCallback) progressCallback(0, (rangeEnd - startAddr));
+
+  // copy the sector from the cache if it can be reused, otherwise download it directly into the output file.
+  // the downloaded sector is also stored in the cache at its address if the cache already reaches the sector
+  // (a shorter cache is not filled with 0xFF up to the sector; the sector is downloaded by the next full download)
+  int32_t dataSize = (rangeEnd - startAddr);
+  if (verifyCache(cache, index, endAddr, headHashes) & (1ULL << newest)) {
+    Serial.printf("Logger.downloadLatest: reusing the cached sector\n");
+    result = copyData(cache, startAddr, output, 0, dataSize);
+  } else {
+    bool toCache = ((int32_t)cache->fileSize() >= startAddr);
+
+    result = downloadRange(output, ((toCache) ? index : NULL), startAddr, &rangeEnd, startAddr, rangeEnd,
+                           progressCallback, &dataEnd);
+    dataSize = (int32_t)output->curPosition();
+    output->truncate(dataSize);
+
+    if ((result) && (toCache)) result = copyData(output, 0, cache, startAddr, dataSize);
+  }
 
-    // send the next download request if the flag set
-    if (nextReq) {
-      // send the download command
-      if (!sendDownloadCommand(nextAddr, REQ_SIZE)) return false;
+  printDownloadSummary();
+  output->flush();
+  cache->flush();
+  if (index != NULL) index->flush();
+  buffer->clear();
+  decoder->clear();
+
+  if (!result) return false;
+
+  if (progressCallback) progressCallback(dataSize, dataSize);
+
+  return true;
+}
+
+/**
+ * @fn bool MtkLogger::downloadRange(File32 *output, File32 *index, int32_t startAddr, int32_t *endAddr,
+ * int32_t baseAddr, int32_t totalSize, void (*progressCallback)(int32_t, int32_t), bool *dataEnd)
+ * @brief Download the log data in the given range and write it to the output file at the offset from baseAddr.
+ * The download requests are pipelined: up to reqWindow requests are kept in flight. The replies are accepted in any
+ * order and written at their address, and the received blocks in the window are tracked by a bitmap. Only the missing
+ * blocks are requested again when the last requested block is received (the blocks before it were lost) or when no
+ * reply is received. The hashes of each completed sector are recorded in the cache index. They are calculated from
+ * the hashes of the blocks taken as the blocks are received (the sector is not read back from the output file).
+ * @param output A pointer to the output file object (its size must be (startAddr - baseAddr) or larger).
+ * @param index A pointer to the cache index file object (or NULL).
+ * @param startAddr The start address of the range (must be a multiple of SIZE_SECTOR).
+ * @param endAddr A pointer to the end address of the range. It is updated to the end of the log data if found.
+ * @param baseAddr The address stored at the beginning of the output file. It is also the start address of the whole
+ * download (the progress is reported relative to this address).
+ * @param totalSize The end address of the whole download (for the progress callback).
+ * @param progressCallback A pointer to the progress callback function.
+ * @param dataEnd A pointer to the flag set true if the end of the log data is found.
+ * @return Returns true if the range is downloaded successfully, otherwise false.
+ */
+bool MtkLogger::downloadRange(File32 *output, File32 *index, int32_t startAddr, int32_t *endAddr,
+                              int32_t baseAddr, int32_t totalSize, void (*progressCallback)(int32_t, int32_t),
+                              bool *dataEnd) {
+  const int8_t MAX_RETRIES = 3;
+  const uint8_t WINDOW_BLOCKS = 64;
+  const uint8_t SECTOR_BLOCKS = (SIZE_SECTOR / SIZE_REPLY);
+
+  /*
+   * Note:
+   * The bitmaps have a bit for each block from nextAddr (bit 0). The requests are clamped so that the window never
+   * reaches beyond nextAddr + MAX_WINDOW_SIZE (= 64 blocks), so the bitmaps fit in 64 bits.
+   * For the same reason, the hashes of the blocks in the window never collide in blockHashes indexed by the block
+   * number modulo 64, and the blocks of a sector take consecutive entries (64 is a multiple of SECTOR_BLOCKS).
+   */
+  uint32_t blockHashes[WINDOW_BLOCKS];  // the hashes of the received blocks (by the block number modulo 64)
+  uint64_t received = 0;     // the blocks received (but not yet passed by nextAddr)
+  uint64_t resent = 0;       // the blocks requested again and not received yet
+  uint32_t reqSentAt = 0;    // the time when a request is sent with no request in flight (0: not measuring)
+  uint32_t lastReplyAt = 0;  // the time when the last block is received (0: not measuring)
+  int32_t nextAddr = startAddr;  // the address of the first block not received
+  int32_t reqAddr = startAddr;   // the address of next data block to request (blocks before this are in flight)
+  int32_t dataEndPos = 0;        // the end position of the log data (valid if dataEnd is set)
+  int8_t retries = 0;            // retry count (continuous timeouts)
+  int16_t timeout = 0;
+
+  // invalidate the index entries of the sectors in the range until they are completed
+  for (int32_t addr = startAddr; addr < *endAddr; addr += SIZE_SECTOR) {
+    writeCacheIndex(index, (addr / SIZE_SECTOR), 0, 0);
+  }
 
-      // reset the flag and the received size
-      nextReq = false;
-      recvSize = 0;
-      timeout = LOG_TIMEOUT1;
+  if (!output->seek(startAddr - baseAddr)) return false;
+
+  while (gpsSerial->connected()) {
+    // break if the range is finished
+    if (nextAddr >= *endAddr) break;
+
+    // the first reply takes longer than the following ones if no request is in flight.
+    // measure the latency of the link with this request
+    timeout = linkStats.timeout2;
+    if ((reqAddr == nextAddr) && (received == 0)) {
+      timeout = linkStats.timeout1;
+      reqSentAt = millis();
+      lastReplyAt = 0;
     }
 
-    // wait for the next data responce
-    // abort the process if the expected responces are NOT received
-    if (!waitForNmeaReply("$PMTK182,8,", timeout)) {
-      Serial.printf("Logger.download: waiting for complete the request\n");
+    // fill the window with the next download requests (not beyond the blocks the bitmaps can track)
+    while ((reqAddr < *endAddr) && ((reqAddr - nextAddr) < (linkStats.reqSize * reqWindow))) {
+      int32_t reqSize = ((*endAddr - reqAddr) < linkStats.reqSize) ? (*endAddr - reqAddr) : linkStats.reqSize;
+      int32_t winLeft = (nextAddr + MAX_WINDOW_SIZE) - reqAddr;
+      if (reqSize > winLeft) reqSize = winLeft;
+      if (reqSize <= 0) break;
 
-      uint16_t remainBlocks = ((REQ_SIZE - recvSize) / SIZE_REPLY) - 1;
-      uint16_t waitTime = remainBlocks * LOG_TIMEOUT2;
-      waitForNmeaReply("$PMTK001,", waitTime);
+      if (!sendDownloadCommand(reqAddr, reqSize)) return false;
 
-      if ((dataEnd) || (retries >= MAX_RETRIES)) break;
+      reqAddr += reqSize;
+    }
+
+    // wait for the next data responce
+    // request again all the missing blocks if NO responce is received
+    if (!waitForDataReply(timeout)) {
+      dlStats.timeouts += 1;
+      if (retries >= MAX_RETRIES) break;
 
-      nextReq = true;
       retries++;
+      adaptLink(true);
+      resent = 0;
+      int32_t winEnd = (reqAddr < *endAddr) ? reqAddr : *endAddr;
+      if (!requestMissingBlocks(nextAddr, winEnd, received, &resent)) return false;
 
-      Serial.printf("Logger.download: retrying (%d/%d)\n", retries, MAX_RETRIES);
+      Serial.printf("Logger.download: retrying from 0x%06X (%d/%d)\n", nextAddr, retries, MAX_RETRIES);
       continue;
     }
 
-    timeout = LOG_TIMEOUT2;
+    // get the starting address of the received data (the 3rd column of the line)
+    int32_t blockAddr = decoder->getAddress();
+
+    // ignore the blocks out of the window and the duplicated blocks
+    if ((blockAddr < nextAddr) || (blockAddr >= reqAddr) || (blockAddr >= *endAddr)) {
+      dlStats.dropped += 1;
+      continue;
+    }
+    uint64_t blockBit = (1ULL << ((blockAddr - nextAddr) / SIZE_REPLY));
+    if (received & blockBit) {
+      dlStats.dropped += 1;
+      continue;
+    }
+    if (blockAddr != nextAddr) dlStats.outOfOrder += 1;
+
+    // scan the decoded block for the end of the log data, then write the data (up to the end of the log data) to the
+    // output file at its offset. the block is 0x800 bytes at an 0x800-aligned offset, so it is written as whole SD
+    // sectors. a gap left by the blocks not received yet is filled by 0xFF until they are received
+    const uint8_t *data = decoder->getData();
+    bool blockEnd = false;
+    uint16_t dataLen = scanDataEnd(data, decoder->getLength(), &blockEnd);
+    int32_t blockPos = (blockAddr - baseAddr);
+    if (blockPos > (int32_t)output->fileSize()) fillData(output, output->fileSize(), blockPos);
+    if (output->curPosition() != (uint32_t)blockPos) output->seek(blockPos);
+    output->write(data, dataLen);
+    blockHashes[(blockAddr / SIZE_REPLY) % WINDOW_BLOCKS] = fnv1a(FNV_INIT, data, decoder->getLength());
+
+    received |= blockBit;
+    resent &= ~blockBit;
+    retries = 0;
+    dlStats.blocks += 1;
+    updateDownloadRate(dataLen);
+
+    // finish the range at this block if it contains the end of the log data
+    // (the blocks after it are discarded and the blocks before it are still downloaded)
+    if (blockEnd) {
+      *dataEnd = true;
+      *endAddr = blockAddr + SIZE_REPLY;
+      dataEndPos = blockAddr + dataLen;
+    }
 
-    // read the starting address of the received data from the 3rd column of the line
-    int32_t startAddr = 0;
-    buffer->readColumnAsInt(2, &startAddr, true);
+    // measure the latency (for the first reply of a request) or the gap between the replies
+    uint32_t now = millis();
+    if (reqSentAt != 0) {
+      updateLinkLatency(now - reqSentAt);
+    } else if (lastReplyAt != 0) {
+      updateLinkGap(now - lastReplyAt);
+    }
+    reqSentAt = 0;
+    lastReplyAt = now;
+    adaptLink(false);
+
+    // if the last requested block is received, the replies of the blocks before it have been lost.
+    // request them again at once instead of waiting for the timeout (only once until the next timeout)
+    int32_t winEnd = (reqAddr < *endAddr) ? reqAddr : *endAddr;
+    if ((blockAddr + SIZE_REPLY) == winEnd) {
+      uint8_t blocks = ((winEnd - nextAddr) / SIZE_REPLY);
+      uint64_t window = (blocks >= 64) ? ~0ULL : ((1ULL << blocks) - 1);
+      if ((window & ~(received | resent)) != 0) {
+        Serial.printf("Logger.download: blocks lost in 0x%06X-0x%06X, requesting again\n", nextAddr, winEnd);
+
+        adaptLink(true);
+        if (!requestMissingBlocks(nextAddr, winEnd, (received | resent), &resent)) return false;
+      }
+    }
 
-    // ignore this line if the starting address is not the expected value
-    if (startAddr != nextAddr) continue;
+    // pass the received blocks at the head of the window
+    while ((received & 1) && (nextAddr < *endAddr)) {
+      received >>= 1;
+      resent >>= 1;
+      nextAddr += SIZE_REPLY;
+
+      // record the hashes of the sector when it is completed (except the sector containing the end of the log data)
+      if (((nextAddr % SIZE_SECTOR) == 0) && (!*dataEnd)) {
+        const uint32_t *hashes = &blockHashes[((nextAddr - SIZE_SECTOR) / SIZE_REPLY) % WINDOW_BLOCKS];
+        uint32_t sectorHash = fnv1a(FNV_INIT, (const uint8_t *)hashes, (SECTOR_BLOCKS * sizeof(uint32_t)));
+        writeCacheIndex(index, ((nextAddr - SIZE_SECTOR) / SIZE_SECTOR), hashes[0], sectorHash);
+      }
+    }
 
     // perform the callback function to notify the progress
-    if (progressCallback) progressCallback(nextAddr, endAddr);
-
-    // read the data from the buffer and write it to the output file
-    // and count the continuous 0xFFs to detect the end of the log data
-    // (the download data will be ignored if endFlag is set)
-    uint8_t by = 0;              // variable to store the next byte
-    uint16_t ffCount = 0;        // counter for how many 0xFFs are continuous
-    buffer->seekCurToColumn(3);  // move to the 4th column (data column)
-    while ((!dataEnd) && (buffer->readHexByteFull(&by))) {
-      output->write(by);
-
-      ffCount = (by != 0xFF) ? 0 : (ffCount + 1);  // count continuous 0xFF
-      dataEnd = (ffCount >= SIZE_HEADER);
-    }  // while ((!dataEnd) ...)
-
-    // update the next address and the received size
-    nextAddr += SIZE_REPLY;
-    recvSize += SIZE_REPLY;
-    nextReq = (recvSize >= REQ_SIZE);
-
-    // update the end address if dataEnd flag is set
-    if (dataEnd) endAddr = nextAddr + (REQ_SIZE - recvSize);
-
-    // wait for the next ACK responce if the size received is enough to send the next request
-    if (recvSize >= REQ_SIZE) waitForNmeaReply("$PMTK001,", ACK_TIMEOUT);
+    if (progressCallback) progressCallback((nextAddr - baseAddr), (totalSize - baseAddr));
   }  // while (gpsSerial.connected())
 
-  // close the output file, then clear the buffer
-  output->flush();
-  buffer->clear();
+  // move to the end of the downloaded data (the output is truncated here if the end of the log data is found)
+  output->seek(((*dataEnd) ? dataEndPos : nextAddr) - baseAddr);
 
-  // finally perform the callback to notify the progress is completed
-  if ((dataEnd) && (progressCallback)) progressCallback(endAddr, endAddr);
+  return (nextAddr >= *endAddr);
+}
 
-  // return true if the download process is finished successfully
-  return ((dataEnd) || (nextAddr >= endAddr));
+/**
+ * @fn bool MtkLogger::requestMissingBlocks(int32_t nextAddr, int32_t reqAddr, uint64_t skip, uint64_t *resent)
+ * @brief Request again the blocks in the window that are not received. The consecutive blocks are requested at once.
+ * @param nextAddr The address of the first block of the window.
+ * @param reqAddr The end address of the window.
+ * @param skip The bitmap of the blocks not to be requested (received or already requested again).
+ * @param resent A pointer to the bitmap to add the requested blocks.
+ * @return Returns true if the requests are sent successfully, otherwise false.
+ */
+bool MtkLogger::requestMissingBlocks(int32_t nextAddr, int32_t reqAddr, uint64_t skip, uint64_t *resent) {
+  uint8_t blocks = ((reqAddr - nextAddr) / SIZE_REPLY);
+  uint8_t i = 0;
+
+  while (i < blocks) {
+    if (skip & (1ULL << i)) {
+      i++;
+      continue;
+    }
+
+    uint8_t runStart = i;
+    while ((i < blocks) && (!(skip & (1ULL << i)))) {
+      *resent |= (1ULL << i);
+      dlStats.resent += 1;
+      i++;
+    }
+    if (!sendDownloadCommand(nextAddr + (runStart * SIZE_REPLY), (i - runStart) * SIZE_REPLY)) return false;
+  }
+
+  return true;
+}
+
+/**
+ * @fn void MtkLogger::resetLinkStats(int32_t reqSize)
+ * @brief Clear the link statistics and set the initial request size and the conservative timeouts.
+ * @param reqSize The initial size of a download request.
+ */
+void MtkLogger::resetLinkStats(int32_t reqSize) {
+  memset(&linkStats, 0, sizeof(linkstats_t));
+
+  linkStats.reqSize = reqSize;
+  linkStats.timeout1 = MAX_TIMEOUT1;
+  linkStats.timeout2 = MAX_TIMEOUT2;
+}
+
+/**
+ * @fn void MtkLogger::updateLinkLatency(uint32_t latency)
+ * @brief Update the smoothed latency from a request to its first reply with the measured value, and recalculate the
+ * timeout for the first reply.
+ * @param latency The measured latency in milliseconds.
+ */
+void MtkLogger::updateLinkLatency(uint32_t latency) {
+  // record the latency in the download statistics
+  dlStats.latencyHist[histBucket(latency, LATENCY_LIMITS)] += 1;
+  if ((dlStats.latencyMin == 0) || (latency < dlStats.latencyMin)) dlStats.latencyMin = latency;
+  if (latency > dlStats.latencyMax) dlStats.latencyMax = latency;
+
+  // smooth the value by an exponential moving average (1/4 weight to the new value)
+  if (linkStats.latency == 0) {
+    linkStats.latency = latency;
+  } else {
+    linkStats.latency = ((linkStats.latency * 3) + latency) / 4;
+  }
+
+  // allow twice the latency (plus the gap between the replies) for the first reply
+  uint32_t tmo = (linkStats.latency * 2) + linkStats.timeout2;
+  linkStats.timeout1 = (tmo < MIN_TIMEOUT1) ? MIN_TIMEOUT1 : (tmo > MAX_TIMEOUT1) ? MAX_TIMEOUT1 : tmo;
+}
+
+/**
+ * @fn void MtkLogger::updateLinkGap(uint32_t gap)
+ * @brief Update the smoothed gap between the replies and its deviation with the measured value, and recalculate the
+ * timeout for the following replies (in the same way as the retransmission timeout of TCP).
+ * @param gap The measured gap in milliseconds.
+ */
+void MtkLogger::updateLinkGap(uint32_t gap) {
+  // record the gap in the download statistics
+  dlStats.gapHist[histBucket(gap, GAP_LIMITS)] += 1;
+
+  if (linkStats.gapAvg == 0) {
+    linkStats.gapAvg = gap;
+    linkStats.gapDev = gap / 2;
+  } else {
+    int32_t err = (int32_t)gap - (int32_t)linkStats.gapAvg;
+    int32_t absErr = (err < 0) ? -err : err;
+    linkStats.gapAvg += err / 8;
+    linkStats.gapDev += (absErr - (int32_t)linkStats.gapDev) / 4;
+  }
+
+  // allow the average gap plus four times of the deviation for the following replies
+  uint32_t tmo = linkStats.gapAvg + (linkStats.gapDev * 4);
+  linkStats.timeout2 = (tmo < MIN_TIMEOUT2) ? MIN_TIMEOUT2 : (tmo > MAX_TIMEOUT2) ? MAX_TIMEOUT2 : tmo;
+}
+
+/**
+ * @fn void MtkLogger::adaptLink(bool failed)
+ * @brief Grow or shrink the request size by the result of a block. The size is halved for each failure and doubled
+ * after four requests of the current size are received without any failure.
+ * @param failed Set true if a block is failed (timeout or lost), or false if a block is received.
+ */
+void MtkLogger::adaptLink(bool failed) {
+  const uint8_t GROW_AFTER = 4;
+
+  int32_t reqSize = linkStats.reqSize;
+
+  if (failed) {
+    // shrink the request size and restore the conservative timeout for the following replies
+    linkStats.retries += 1;
+    linkStats.cleanSize = 0;
+    linkStats.timeout2 = MAX_TIMEOUT2;
+    if (reqSize > MIN_REQ_SIZE) reqSize /= 2;
+  } else {
+    linkStats.blocks += 1;
+    linkStats.cleanSize += SIZE_REPLY;
+    if ((linkStats.cleanSize >= (reqSize * GROW_AFTER)) && (reqSize < MAX_REQ_SIZE)) {
+      reqSize *= 2;
+      linkStats.cleanSize = 0;
+    }
+  }
+
+  if (reqSize != linkStats.reqSize) {
+    Serial.printf("Logger.download: request size 0x%04X -> 0x%04X [timeout=%d/%d]\n",  //
+                  linkStats.reqSize, reqSize, linkStats.timeout1, linkStats.timeout2);
+    linkStats.reqSize = reqSize;
+  }
+}
+
+/**
+ * @fn void MtkLogger::resetDownloadStats()
+ * @brief Clear the download statistics and start measuring the time and the throughput.
+ */
+void MtkLogger::resetDownloadStats() {
+  memset(&dlStats, 0, sizeof(dlstats_t));
+  dlStartAt = millis();
+  rateWindowAt = dlStartAt;
+  rateWindowBytes = 0;
+  decoderErrors = decoder->getErrors();
+  rxRing->resetStats();
+}
+
+/**
+ * @fn void MtkLogger::updateDownloadRate(uint32_t bytes)
+ * @brief Count the received bytes and update the throughput when a window (RATE_WINDOW) is passed.
+ * @param bytes The number of the bytes received.
+ */
+void MtkLogger::updateDownloadRate(uint32_t bytes) {
+  uint32_t now = millis();
+
+  dlStats.bytes += bytes;
+  rateWindowBytes += bytes;
+
+  uint32_t span = now - rateWindowAt;
+  if (span >= RATE_WINDOW) {
+    dlStats.rateNow = (rateWindowBytes * 1000) / span;
+    if ((dlStats.rateMin == 0) || (dlStats.rateNow < dlStats.rateMin)) dlStats.rateMin = dlStats.rateNow;
+    if (dlStats.rateNow > dlStats.rateMax) dlStats.rateMax = dlStats.rateNow;
+
+    rateWindowAt = now;
+    rateWindowBytes = 0;
+  }
+}
+
+/**
+ * @fn void MtkLogger::finishDownloadStats()
+ * @brief Finish the download statistics (the elapsed time, the average throughput and the counters of the decoder
+ * and the rx ring buffer).
+ */
+void MtkLogger::finishDownloadStats() {
+  dlStats.elapsed = millis() - dlStartAt;
+  dlStats.rateAvg = (dlStats.elapsed == 0) ? 0 : (uint32_t)(((uint64_t)dlStats.bytes * 1000) / dlStats.elapsed);
+  dlStats.broken = decoder->getErrors() - decoderErrors;
+  dlStats.rxHighWater = rxRing->getHighWater();
+  dlStats.rxOverflow = rxRing->getOverflow();
+}
+
+/**
+ * @fn void MtkLogger::printDownloadSummary()
+ * @brief Finish the statistics of the download and print the summary in one line.
+ */
+void MtkLogger::printDownloadSummary() {
+  finishDownloadStats();
+  Serial.printf(
+      "Logger.download: summary [bytes=%d, time=%d, rate=%d/%d/%d/%d, reqs=%d, blocks=%d, timeouts=%d, resent=%d, "
+      "ooo=%d, dropped=%d, broken=%d, latency=%d-%d, lat-hist=%d/%d/%d/%d/%d/%d/%d/%d, "
+      "gap-hist=%d/%d/%d/%d/%d/%d/%d/%d, size=0x%04X, rx=%d/%d]\n",
+      dlStats.bytes, dlStats.elapsed, dlStats.rateAvg, dlStats.rateMin, dlStats.rateMax, dlStats.rateNow,
+      dlStats.requests, dlStats.blocks, dlStats.timeouts, dlStats.resent, dlStats.outOfOrder, dlStats.dropped,
+      dlStats.broken, dlStats.latencyMin, dlStats.latencyMax, dlStats.latencyHist[0], dlStats.latencyHist[1],
+      dlStats.latencyHist[2], dlStats.latencyHist[3], dlStats.latencyHist[4], dlStats.latencyHist[5],
+      dlStats.latencyHist[6], dlStats.latencyHist[7], dlStats.gapHist[0], dlStats.gapHist[1], dlStats.gapHist[2],
+      dlStats.gapHist[3], dlStats.gapHist[4], dlStats.gapHist[5], dlStats.gapHist[6], dlStats.gapHist[7],
+      linkStats.reqSize, dlStats.rxHighWater, dlStats.rxOverflow);
+}
+
+/**
+ * @fn uint8_t MtkLogger::histBucket(uint32_t value, const uint16_t *limits)
+ * @brief Determine the bucket of a histogram for the value.
+ * @param value The value to count.
+ * @param limits The upper limits (exclusive) of the buckets except the last one (DL_HIST_BUCKETS - 1 values).
+ * @return Returns the index of the bucket.
+ */
+uint8_t MtkLogger::histBucket(uint32_t value, const uint16_t *limits) {
+  uint8_t i = 0;
+  while ((i < (DL_HIST_BUCKETS - 1)) && (value >= limits[i])) i++;
+
+  return i;
+}
+
+/**
+ * @fn dlstats_t MtkLogger::getDownloadStats()
+ * @brief Get the statistics of the last download.
+ * @return Returns the download statistics.
+ */
+dlstats_t MtkLogger::getDownloadStats() {
+  return dlStats;
+}
+
+/**
+ * @fn linkstats_t MtkLogger::getLinkStats()
+ * @brief Get the link statistics measured in the last download.
+ * @return Returns the link statistics.
+ */
+linkstats_t MtkLogger::getLinkStats() {
+  return linkStats;
+}
+
+/**
+ * @fn uint32_t MtkLogger::getRxHighWater()
+ * @brief Get the max number of bytes held in the receive ring buffer during the last download.
+ * @return Returns the high-water mark in bytes.
+ */
+uint32_t MtkLogger::getRxHighWater() {
+  return rxRing->getHighWater();
+}
+
+/**
+ * @fn uint32_t MtkLogger::getRxOverflow()
+ * @brief Get the number of bytes lost because the receive ring buffer was full during the last download.
+ * @return Returns the number of bytes lost.
+ */
+uint32_t MtkLogger::getRxOverflow() {
+  return rxRing->getOverflow();
+}
+
+/**
+ * @fn void MtkLogger::setDownloadWindow(uint8_t window)
+ * @brief Set the number of download requests kept in flight during downloadLogData().
+ * @param window The number of requests (1 to MAX_REQ_WINDOW). 1 means the stop-and-wait download.
+ */
+void MtkLogger::setDownloadWindow(uint8_t window) {
+  if (window < 1) window = 1;
+  if (window > MAX_REQ_WINDOW) window = MAX_REQ_WINDOW;
+
+  reqWindow = window;
 }
 
 /**
@@ -639,9 +1759,21 @@ bool MtkLogger::setLogRecordMode(recordmode_t recmode) {
  * @return true if the command is done successfully, otherwise false.
  */
 bool MtkLogger::getLogCriteria(logcriteria_t *criteria) {
-  if (!getLogByDistance(&criteria->distance)) return false;
-  if (!getLogByTime(&criteria->time)) return false;
-  if (!getLogBySpeed(&criteria->speed)) return false;
+  int32_t values[3] = {0, 0, 0};
+  nmeaquery_t queries[] = {
+      {"PMTK182,2,4", "$PMTK182,3,4,", &readDecValue, &values[0]},  // log by distance
+      {"PMTK182,2,3", "$PMTK182,3,3,", &readDecValue, &values[1]},  // log by time
+      {"PMTK182,2,5", "$PMTK182,3,5,", &readDecValue, &values[2]},  // log by speed
+  };
+
+  if (!sendNmeaBatch(queries, 3, MSG_TIMEOUT)) return false;
+
+  criteria->distance = values[0];
+  criteria->time = values[1];
+  criteria->speed = values[2];
+
+  Serial.printf("Logger.logCriteria: %d meter, %d.%d sec, %d km/h\n",  //
+                (criteria->distance / 10), (criteria->time / 10), (criteria->time % 10), (criteria->speed / 10));
 
   return true;
 }
@@ -653,11 +1785,42 @@ bool MtkLogger::getLogCriteria(logcriteria_t *criteria) {
  * @return True if the command is done successfully, otherwise false.
  */
 bool MtkLogger::setLogCriteria(logcriteria_t criteria) {
-  if (!setLogByDistance(criteria.distance)) return false;
-  if (!setLogByTime(criteria.time)) return false;
-  if (!setLogBySpeed(criteria.speed)) return false;
+  char cmdstr[3][24];
+  sprintf(cmdstr[0], "PMTK182,1,4,%d", (criteria.distance < 0) ? 0 : criteria.distance);  // log by distance
+  sprintf(cmdstr[1], "PMTK182,1,3,%d", (criteria.time < 0) ? 0 : criteria.time);          // log by time
+  sprintf(cmdstr[2], "PMTK182,1,5,%d", (criteria.speed < 0) ? 0 : criteria.speed);        // log by speed
+
+  nmeaquery_t queries[] = {
+      {cmdstr[0], "$PMTK001,182,1,3", NULL, NULL},
+      {cmdstr[1], "$PMTK001,182,1,3", NULL, NULL},
+      {cmdstr[2], "$PMTK001,182,1,3", NULL, NULL},
+  };
+
+  return sendNmeaBatch(queries, 3, MSG_TIMEOUT);
+}
 
-  return true;
+/**
+ * @fn bool MtkLogger::setLogMode(recordmode_t recmode, logcriteria_t criteria)
+ * @brief Set the log record mode and the logging criteria of the connected logger at once.
+ * @param recmode The log record mode to set.
+ * @param criteria The log criteria to set.
+ * @return True if the command is done successfully, otherwise false.
+ */
+bool MtkLogger::setLogMode(recordmode_t recmode, logcriteria_t criteria) {
+  char cmdstr[4][24];
+  sprintf(cmdstr[0], "PMTK182,1,6,%d", recmode);                                           // record mode
+  sprintf(cmdstr[1], "PMTK182,1,4,%d", (criteria.distance < 0) ? 0 : criteria.distance);  // log by distance
+  sprintf(cmdstr[2], "PMTK182,1,3,%d", (criteria.time < 0) ? 0 : criteria.time);          // log by time
+  sprintf(cmdstr[3], "PMTK182,1,5,%d", (criteria.speed < 0) ? 0 : criteria.speed);        // log by speed
+
+  nmeaquery_t queries[] = {
+      {cmdstr[0], "$PMTK001,182,1,3", NULL, NULL},
+      {cmdstr[1], "$PMTK001,182,1,3", NULL, NULL},
+      {cmdstr[2], "$PMTK001,182,1,3", NULL, NULL},
+      {cmdstr[3], "$PMTK001,182,1,3", NULL, NULL},
+  };
+
+  return sendNmeaBatch(queries, 4, MSG_TIMEOUT);
 }
 
 /**
@@ -839,13 +2002,32 @@ bool MtkLogger::clearFlash(void (*rateCallback)(int32_t, int32_t)) {
  * @param cbfunc a function pointer to the event callback function.
  */
 void MtkLogger::setEventCallback(esp_spp_cb_t cbfunc) {
-  if (cbfunc != NULL) {
-    gpsSerial->register_callback(cbfunc);
-  }
-
+  // the function is called from sppCallback() (the handler registered to the BluetoothSerial)
+  appCallback = cbfunc;
   eventCallback = cbfunc;
 }
 
+/**
+ * @fn bool MtkLogger::keepAlive()
+ * @brief Send a test command to the connected logger to check the link is alive. The characters received while the
+ * link was idle are discarded before sending.
+ * @return true if the logger replied, otherwise false.
+ */
+bool MtkLogger::keepAlive() {
+  // discard the sentences received while the link was idle
+  buffer->clear();
+  decoder->clear();
+  rxPos = 0;
+  rxLen = 0;
+  rxRing->clear();
+
+  // send PMTK_TEST command and wait for its ACK
+  if (!sendNmeaCommand("PMTK000")) return false;
+  if (!waitForNmeaReply("$PMTK001,0,", MSG_TIMEOUT)) return false;
+
+  return true;
+}
+
 /**
  * @fn bool MtkLogger::reloadDevice()
  * @brief Send a hot start command to the connected logger to reload the device.
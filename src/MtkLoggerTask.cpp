@@ -0,0 +1,423 @@
+#include "MtkLoggerTask.h"
+
+/**
+ * @fn MtkLoggerTask::MtkLoggerTask(MtkLogger *lgr)
+ * @brief Constructor of MtkLoggerTask class. The task is not started until begin() is called.
+ * @param lgr A pointer to the MtkLogger object to run the jobs with.
+ */
+MtkLoggerTask::MtkLoggerTask(MtkLogger *lgr) {
+  logger = lgr;
+  jobQueue = NULL;
+  doneQueue = NULL;
+  task = NULL;
+  running = false;
+  lastId = 0;
+}
+
+/**
+ * @fn bool MtkLoggerTask::begin(UBaseType_t priority, BaseType_t core)
+ * @brief Create the job queues and start the logger task.
+ * @param priority The priority of the logger task.
+ * @param core The CPU core to run the logger task on.
+ * @return Returns true if the task is started (or already started), otherwise false.
+ */
+bool MtkLoggerTask::begin(UBaseType_t priority, BaseType_t core) {
+  if (task != NULL) return true;
+
+  jobQueue = xQueueCreate(QUEUE_LENGTH, sizeof(loggerjob_t));
+  doneQueue = xQueueCreate(QUEUE_LENGTH, sizeof(loggerjob_t));
+  if ((jobQueue == NULL) || (doneQueue == NULL)) {
+    Serial.printf("LoggerTask.begin: could not create the queues\n");
+    return false;
+  }
+
+  if (xTaskCreatePinnedToCore(&taskMain, "MtkLogger", STACK_SIZE, this, priority, &task, core) != pdPASS) {
+    Serial.printf("LoggerTask.begin: could not create the task\n");
+    task = NULL;
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * @fn void MtkLoggerTask::taskMain(void *arg)
+ * @brief The main loop of the logger task. Take the jobs from the queue and run them one by one.
+ * @param arg A pointer to the MtkLoggerTask object.
+ */
+void MtkLoggerTask::taskMain(void *arg) {
+  MtkLoggerTask *self = (MtkLoggerTask *)arg;
+  loggerjob_t job;
+
+  while (true) {
+    if (xQueueReceive(self->jobQueue, &job, portMAX_DELAY) != pdTRUE) continue;
+
+    self->running = true;
+    self->runJob(&job);
+    self->running = false;
+
+    // notify the completion by the callback, or post the job to the completion queue.
+    // if the queue is full of the completions nobody waited for, drop the oldest one to post this one
+    if (job.completeCallback != NULL) {
+      job.completeCallback(&job, job.param);
+    } else if (xQueueSend(self->doneQueue, &job, 0) != pdTRUE) {
+      loggerjob_t stale;
+      if (xQueueReceive(self->doneQueue, &stale, 0) == pdTRUE) {
+        Serial.printf("LoggerTask.main: dropped the completion of job #%u\n", stale.id);
+      }
+      xQueueSend(self->doneQueue, &job, 0);
+    }
+  }
+}
+
+/**
+ * @fn void MtkLoggerTask::runJob(loggerjob_t *job)
+ * @brief Run a job with the (blocking) MtkLogger method and store the result in the job.
+ * @param job A pointer to the job to run.
+ */
+void MtkLoggerTask::runJob(loggerjob_t *job) {
+  Serial.printf("LoggerTask.run: job %d started (t=%d)\n", job->type, millis());
+
+  switch (job->type) {
+  case JOB_CONNECT:
+    job->result = logger->connect(job->address);
+    break;
+  case JOB_DISCONNECT:
+    logger->disconnect();
+    job->result = true;
+    break;
+  case JOB_KEEPALIVE:
+    job->result = logger->keepAlive();
+    break;
+  case JOB_DOWNLOAD:
+    job->result = logger->downloadLogData(job->output, job->progressCallback, job->index);
+    break;
+  case JOB_DOWNLOAD_LATEST:
+    job->result = logger->downloadLatestData(job->cache, job->output, job->progressCallback, job->index);
+    break;
+  case JOB_CLEAR_FLASH:
+    job->result = logger->clearFlash(job->progressCallback);
+    break;
+  case JOB_RELOAD:
+    job->result = logger->reloadDevice();
+    break;
+  case JOB_FIX_RTC:
+    job->result = logger->fixRTCdatetime();
+    break;
+  case JOB_GET_LOG_FORMAT:
+    job->result = logger->getLogFormat(&job->format);
+    break;
+  case JOB_SET_LOG_FORMAT:
+    job->result = logger->setLogFormat(job->format);
+    break;
+  case JOB_GET_LOG_MODE:
+    job->result = ((logger->getLogRecordMode(&job->recordMode)) && (logger->getLogCriteria(&job->criteria)));
+    break;
+  case JOB_SET_LOG_MODE:
+    job->result = logger->setLogMode(job->recordMode, job->criteria);
+    break;
+  default:
+    job->result = false;
+    break;
+  }
+
+  Serial.printf("LoggerTask.run: job %d %s (t=%d)\n", job->type, (job->result) ? "done" : "failed", millis());
+}
+
+/**
+ * @fn uint32_t MtkLoggerTask::submit(loggerjob_t *job)
+ * @brief Queue a job to run on the logger task. The job is copied, so the caller need not keep it.
+ * @param job A pointer to the job to queue. Its id is set to the sequence number of the job.
+ * @return Returns the id of the queued job, or 0 if the job is not queued (the task is not started or the queue is
+ * full).
+ */
+uint32_t MtkLoggerTask::submit(loggerjob_t *job) {
+  if (task == NULL) return 0;
+
+  lastId = (lastId == UINT32_MAX) ? 1 : (lastId + 1);
+  job->id = lastId;
+  job->result = false;
+
+  return (xQueueSend(jobQueue, job, 0) == pdTRUE) ? job->id : 0;
+}
+
+/**
+ * @fn bool MtkLoggerTask::waitForCompletion(uint32_t id, loggerjob_t *job, uint32_t timeout)
+ * @brief Wait for the given job completed without a completeCallback. The calling task sleeps while waiting. The
+ * completions of the other jobs taken from the completion queue (the jobs nobody waited for) are discarded.
+ * @param id The id of the job returned when it is queued.
+ * @param job A pointer to the variable to store the completed job.
+ * @param timeout The timeout period in milliseconds.
+ * @return Returns true if the job is completed, otherwise false.
+ */
+bool MtkLoggerTask::waitForCompletion(uint32_t id, loggerjob_t *job, uint32_t timeout) {
+  if ((task == NULL) || (id == 0)) return false;
+
+  uint32_t startAt = millis();
+  while (true) {
+    uint32_t elapsed = millis() - startAt;
+    uint32_t left = (elapsed < timeout) ? (timeout - elapsed) : 0;
+    if (xQueueReceive(doneQueue, job, pdMS_TO_TICKS(left)) != pdTRUE) return false;
+    if (job->id == id) return true;
+
+    Serial.printf("LoggerTask.wait: discarded the completion of job #%u\n", job->id);
+  }
+}
+
+/**
+ * @fn bool MtkLoggerTask::busy()
+ * @brief Check if a job is running or waiting in the queue.
+ * @return Returns true if the logger task is busy, otherwise false.
+ */
+bool MtkLoggerTask::busy() {
+  if (task == NULL) return false;
+
+  return ((running) || (uxQueueMessagesWaiting(jobQueue) > 0));
+}
+
+/**
+ * @fn bool MtkLoggerTask::connected()
+ * @brief Check if the logger is connected. Only the state of the link is read, so this can be called while a job is
+ * running.
+ * @return Returns true if the logger is connected, otherwise false.
+ */
+bool MtkLoggerTask::connected() {
+  return logger->connected();
+}
+
+/**
+ * @fn uint32_t MtkLoggerTask::connect(uint8_t *addr, void (*cb)(loggerjob_t *, void *), void *param)
+ * @brief Queue a job to connect to the logger with the given address.
+ * @param addr A pointer to the address (6 bytes) of the logger.
+ * @param cb A pointer to the function called when the job is completed (or NULL to use the completion queue).
+ * @param param A parameter passed to the callback function.
+ * @return Returns the id of the queued job, or 0 if the job is not queued.
+ */
+uint32_t MtkLoggerTask::connect(uint8_t *addr, void (*cb)(loggerjob_t *, void *), void *param) {
+  loggerjob_t job;
+  memset(&job, 0, sizeof(job));
+  job.type = JOB_CONNECT;
+  memcpy(job.address, addr, sizeof(job.address));
+  job.completeCallback = cb;
+  job.param = param;
+
+  return submit(&job);
+}
+
+/**
+ * @fn uint32_t MtkLoggerTask::disconnect(void (*cb)(loggerjob_t *, void *), void *param)
+ * @brief Queue a job to disconnect from the logger.
+ * @param cb A pointer to the function called when the job is completed (or NULL to use the completion queue).
+ * @param param A parameter passed to the callback function.
+ * @return Returns the id of the queued job, or 0 if the job is not queued.
+ */
+uint32_t MtkLoggerTask::disconnect(void (*cb)(loggerjob_t *, void *), void *param) {
+  loggerjob_t job;
+  memset(&job, 0, sizeof(job));
+  job.type = JOB_DISCONNECT;
+  job.completeCallback = cb;
+  job.param = param;
+
+  return submit(&job);
+}
+
+/**
+ * @fn uint32_t MtkLoggerTask::keepAlive(void (*cb)(loggerjob_t *, void *), void *param)
+ * @brief Queue a job to check if the logger answers on the current link.
+ * @param cb A pointer to the function called when the job is completed (or NULL to use the completion queue).
+ * @param param A parameter passed to the callback function.
+ * @return Returns the id of the queued job, or 0 if the job is not queued.
+ */
+uint32_t MtkLoggerTask::keepAlive(void (*cb)(loggerjob_t *, void *), void *param) {
+  loggerjob_t job;
+  memset(&job, 0, sizeof(job));
+  job.type = JOB_KEEPALIVE;
+  job.completeCallback = cb;
+  job.param = param;
+
+  return submit(&job);
+}
+
+/**
+ * @fn uint32_t MtkLoggerTask::downloadLogData(File32 *output, void (*progressCallback)(int32_t, int32_t),
+ * File32 *index, void (*cb)(loggerjob_t *, void *), void *param)
+ * @brief Queue a job to download the log data. The output and index files must be kept open until the job completes.
+ * @param output A pointer to the output file object.
+ * @param progressCallback A pointer to the progress callback function (called on the logger task).
+ * @param index A pointer to the cache index file object (or NULL).
+ * @param cb A pointer to the function called when the job is completed (or NULL to use the completion queue).
+ * @param param A parameter passed to the callback function.
+ * @return Returns the id of the queued job, or 0 if the job is not queued.
+ */
+uint32_t MtkLoggerTask::downloadLogData(File32 *output, void (*progressCallback)(int32_t, int32_t), File32 *index,
+                                        void (*cb)(loggerjob_t *, void *), void *param) {
+  loggerjob_t job;
+  memset(&job, 0, sizeof(job));
+  job.type = JOB_DOWNLOAD;
+  job.output = output;
+  job.index = index;
+  job.progressCallback = progressCallback;
+  job.completeCallback = cb;
+  job.param = param;
+
+  return submit(&job);
+}
+
+/**
+ * @fn uint32_t MtkLoggerTask::downloadLatestData(File32 *cache, File32 *output, void (*progressCallback)(int32_t,
+ * int32_t), File32 *index, void (*cb)(loggerjob_t *, void *), void *param)
+ * @brief Queue a job to download the newest sector of the log data. The files must be kept open until the job
+ * completes.
+ * @param cache A pointer to the download cache file object.
+ * @param output A pointer to the output file object.
+ * @param progressCallback A pointer to the progress callback function (called on the logger task).
+ * @param index A pointer to the cache index file object (or NULL).
+ * @param cb A pointer to the function called when the job is completed (or NULL to use the completion queue).
+ * @param param A parameter passed to the callback function.
+ * @return Returns the id of the queued job, or 0 if the job is not queued.
+ */
+uint32_t MtkLoggerTask::downloadLatestData(File32 *cache, File32 *output, void (*progressCallback)(int32_t, int32_t),
+                                           File32 *index, void (*cb)(loggerjob_t *, void *), void *param) {
+  loggerjob_t job;
+  memset(&job, 0, sizeof(job));
+  job.type = JOB_DOWNLOAD_LATEST;
+  job.cache = cache;
+  job.output = output;
+  job.index = index;
+  job.progressCallback = progressCallback;
+  job.completeCallback = cb;
+  job.param = param;
+
+  return submit(&job);
+}
+
+/**
+ * @fn uint32_t MtkLoggerTask::clearFlash(void (*progressCallback)(int32_t, int32_t), void (*cb)(loggerjob_t *, void *),
+ * void *param)
+ * @brief Queue a job to clear the log data in the flash of the logger.
+ * @param progressCallback A pointer to the progress callback function (called on the logger task).
+ * @param cb A pointer to the function called when the job is completed (or NULL to use the completion queue).
+ * @param param A parameter passed to the callback function.
+ * @return Returns the id of the queued job, or 0 if the job is not queued.
+ */
+uint32_t MtkLoggerTask::clearFlash(void (*progressCallback)(int32_t, int32_t), void (*cb)(loggerjob_t *, void *),
+                                   void *param) {
+  loggerjob_t job;
+  memset(&job, 0, sizeof(job));
+  job.type = JOB_CLEAR_FLASH;
+  job.progressCallback = progressCallback;
+  job.completeCallback = cb;
+  job.param = param;
+
+  return submit(&job);
+}
+
+/**
+ * @fn uint32_t MtkLoggerTask::reloadDevice(void (*cb)(loggerjob_t *, void *), void *param)
+ * @brief Queue a job to reload (restart) the logger.
+ * @param cb A pointer to the function called when the job is completed (or NULL to use the completion queue).
+ * @param param A parameter passed to the callback function.
+ * @return Returns the id of the queued job, or 0 if the job is not queued.
+ */
+uint32_t MtkLoggerTask::reloadDevice(void (*cb)(loggerjob_t *, void *), void *param) {
+  loggerjob_t job;
+  memset(&job, 0, sizeof(job));
+  job.type = JOB_RELOAD;
+  job.completeCallback = cb;
+  job.param = param;
+
+  return submit(&job);
+}
+
+/**
+ * @fn uint32_t MtkLoggerTask::fixRTCdatetime(void (*cb)(loggerjob_t *, void *), void *param)
+ * @brief Queue a job to fix the RTC date/time of the logger.
+ * @param cb A pointer to the function called when the job is completed (or NULL to use the completion queue).
+ * @param param A parameter passed to the callback function.
+ * @return Returns the id of the queued job, or 0 if the job is not queued.
+ */
+uint32_t MtkLoggerTask::fixRTCdatetime(void (*cb)(loggerjob_t *, void *), void *param) {
+  loggerjob_t job;
+  memset(&job, 0, sizeof(job));
+  job.type = JOB_FIX_RTC;
+  job.completeCallback = cb;
+  job.param = param;
+
+  return submit(&job);
+}
+
+/**
+ * @fn uint32_t MtkLoggerTask::getLogFormat(void (*cb)(loggerjob_t *, void *), void *param)
+ * @brief Queue a job to get the log format. The format is stored in the completed job.
+ * @param cb A pointer to the function called when the job is completed (or NULL to use the completion queue).
+ * @param param A parameter passed to the callback function.
+ * @return Returns the id of the queued job, or 0 if the job is not queued.
+ */
+uint32_t MtkLoggerTask::getLogFormat(void (*cb)(loggerjob_t *, void *), void *param) {
+  loggerjob_t job;
+  memset(&job, 0, sizeof(job));
+  job.type = JOB_GET_LOG_FORMAT;
+  job.completeCallback = cb;
+  job.param = param;
+
+  return submit(&job);
+}
+
+/**
+ * @fn uint32_t MtkLoggerTask::setLogFormat(uint32_t format, void (*cb)(loggerjob_t *, void *), void *param)
+ * @brief Queue a job to set the log format.
+ * @param format The log format to set.
+ * @param cb A pointer to the function called when the job is completed (or NULL to use the completion queue).
+ * @param param A parameter passed to the callback function.
+ * @return Returns the id of the queued job, or 0 if the job is not queued.
+ */
+uint32_t MtkLoggerTask::setLogFormat(uint32_t format, void (*cb)(loggerjob_t *, void *), void *param) {
+  loggerjob_t job;
+  memset(&job, 0, sizeof(job));
+  job.type = JOB_SET_LOG_FORMAT;
+  job.format = format;
+  job.completeCallback = cb;
+  job.param = param;
+
+  return submit(&job);
+}
+
+/**
+ * @fn uint32_t MtkLoggerTask::getLogMode(void (*cb)(loggerjob_t *, void *), void *param)
+ * @brief Queue a job to get the record mode and the log criteria. They are stored in the completed job.
+ * @param cb A pointer to the function called when the job is completed (or NULL to use the completion queue).
+ * @param param A parameter passed to the callback function.
+ * @return Returns the id of the queued job, or 0 if the job is not queued.
+ */
+uint32_t MtkLoggerTask::getLogMode(void (*cb)(loggerjob_t *, void *), void *param) {
+  loggerjob_t job;
+  memset(&job, 0, sizeof(job));
+  job.type = JOB_GET_LOG_MODE;
+  job.completeCallback = cb;
+  job.param = param;
+
+  return submit(&job);
+}
+
+/**
+ * @fn uint32_t MtkLoggerTask::setLogMode(recordmode_t recmode, logcriteria_t criteria,
+ * void (*cb)(loggerjob_t *, void *), void *param)
+ * @brief Queue a job to set the record mode and the log criteria.
+ * @param recmode The record mode to set.
+ * @param criteria The log criteria to set.
+ * @param cb A pointer to the function called when the job is completed (or NULL to use the completion queue).
+ * @param param A parameter passed to the callback function.
+ * @return Returns the id of the queued job, or 0 if the job is not queued.
+ */
+uint32_t MtkLoggerTask::setLogMode(recordmode_t recmode, logcriteria_t criteria, void (*cb)(loggerjob_t *, void *),
+                                   void *param) {
+  loggerjob_t job;
+  memset(&job, 0, sizeof(job));
+  job.type = JOB_SET_LOG_MODE;
+  job.recordMode = recmode;
+  job.criteria = criteria;
+  job.completeCallback = cb;
+  job.param = param;
+
+  return submit(&job);
+}
@@ -13,10 +13,44 @@
 MtkParser::MtkParser(parseopt_t opts) {
   memset(&options, 0, sizeof(parseopt_t));
   memset(&status, 0, sizeof(parsestatus_t));
+  simplifier = NULL;
 
   setOptions(opts);
 }
 
+/**
+ * @fn void MtkParser::putTrkpt(gpsrecord_t rcd)
+ * @brief Put a TRKPT to the output. The TRKPT is passed through the track simplifier if it is enabled.
+ * @param rcd A gpsrecord_t structure that contains the TRKPT to put.
+ */
+void MtkParser::putTrkpt(gpsrecord_t rcd) {
+  if (simplifier != NULL) {
+    simplifier->putTrkpt(rcd);
+  } else {
+    out->putTrkpt(rcd);
+  }
+}
+
+/**
+ * @fn void MtkParser::endTrack()
+ * @brief Close the current track of the output. The pending TRKPT in the track simplifier is written before closing.
+ */
+void MtkParser::endTrack() {
+  if (simplifier != NULL) {
+    simplifier->endTrack();
+  } else {
+    out->endTrack();
+  }
+}
+
+/**
+ * @fn uint32_t MtkParser::getLastTime()
+ * @brief Return the timestamp of the last TRKPT put to the output (including the TRKPTs pending in the simplifier).
+ */
+uint32_t MtkParser::getLastTime() {
+  return (simplifier != NULL) ? simplifier->getLastTime() : out->getLastTime();
+}
+
 /**
  * @fn bool isDifferentDate(uint32_t t1, uint32_t t2)
  * @brief Compare timestamps to determine if they are in different dates or same date. The comparison is based in the
@@ -60,6 +94,28 @@ void MtkParser::setRecordFormat(uint32_t format) {
   Serial.printf("Parser.setFormat: change format [reg=0x%08X]\n", format);
 }
 
+/**
+ * @fn uint16_t MtkParser::getRecordSize()
+ * @brief Calculate the size of a record in the binary log data from the current record format. The size of the SID
+ * field is estimated without the satellite data because it is variable-length.
+ * @return Returns the size of a record in bytes, including the checksum delimiter and the checksum field.
+ */
+uint16_t MtkParser::getRecordSize() {
+  uint32_t format = status.logFormat;
+  uint16_t size = (sizeof(char) + sizeof(uint8_t));  // '*' and checksum
+
+  size += status.ignoreSize1 + status.ignoreSize2 + status.ignoreSize4;
+  size += (sizeof(uint32_t) * (bool)(format & FMT_TIME));
+  size += (sizeof(double) * (bool)(format & FMT_LAT));
+  size += (sizeof(double) * (bool)(format & FMT_LON));
+  size += (sizeof(float) * (bool)(format & FMT_HEIGHT));
+  size += (sizeof(float) * (bool)(format & FMT_SPEED));
+  size += (sizeof(uint32_t) * (bool)(format & FMT_SID));
+  size += (sizeof(uint16_t) * (bool)(format & FMT_RCR));
+
+  return size;
+}
+
 /**
  * @fn void MtkParser::setOptions(parseopt_t opts)
  * @brief Set the options for the parser.
@@ -235,7 +291,7 @@ bool MtkParser::readBinMarkers() {
 
       case DST_LOG_STARTSTOP:  // log start(0x106), stop(0x0104)
         if ((dsp.value == DSV_LOG_START) && (options.trackMode == TRK_AS_IS)) {
-          out->endTrack();
+          endTrack();
         }
         break;
 
@@ -272,21 +328,37 @@ bool MtkParser::readBinMarkers() {
 }
 
 /**
- * @fn gpxinfo_t MtkParser::convert(File32 *input, File32 *output, void (*progressCallback)(int32_t, int32_t))
+ * @fn gpxinfo_t MtkParser::convert(File32 *input, File32 *output, void (*progressCallback)(int32_t, int32_t),
+ * void (*rolloverCallback)(File32 *, File32 *, gpxinfo_t), File32 *statsOutput)
  * @brief Read a GPS data record from the current position in the input file. The read record is valid, write it as a
  * TRKPT into the output file and move to the next position. Otherwise, move the position to the next byte.
  * @param input
  * @param output
  * @param progressCallback
+ * @param rolloverCallback A pointer to the callback function that is called each time a GPX file is finished at a
+ * track boundary. The function should save the finished file and re-open the output for the next track. If NULL is
+ * given, all tracks are written into a single GPX file.
+ * @param statsOutput The file to write the track statistics (JSON) into. It is finished and passed to the rollover
+ * callback together with the output. If NULL is given, no statistics are written.
+ * @return Returns the GPX information of all tracks written.
  */
-gpxinfo_t MtkParser::convert(File32 *input, File32 *output, void (*progressCallback)(int32_t, int32_t)) {
+gpxinfo_t MtkParser::convert(File32 *input, File32 *output, void (*progressCallback)(int32_t, int32_t),
+                             void (*rolloverCallback)(File32 *, File32 *, gpxinfo_t), File32 *statsOutput) {
   // clear the status before starting the conversion
   memset(&status, 0, sizeof(parsestatus_t));
 
   // create the input and output file objects
   in = new MtkFileReader(input);
-  out = new GpxFileWriter(output);
+  out = new GpxFileWriter(output, options.compress);
   out->setTimeOffset(options.timeOffset);  // set the time offset to the output
+  out->setRolloverCallback(rolloverCallback);
+  out->setStatsOutput(statsOutput);
+
+  // create the track simplifier if the tolerance is set
+  simplifier = NULL;
+  if (options.simplifyTolerance > 0) {
+    simplifier = new TrackSimplifier(out, options.simplifyTolerance);
+  }
 
   // set the initial values for the progress callback
   uint8_t progRate = 0;
@@ -338,6 +410,12 @@ gpxinfo_t MtkParser::convert(File32 *input, File32 *output, void (*progressCallb
       in->readBytes(&fmt, sizeof(uint32_t));
       setRecordFormat(fmt);
       in->seekCur(dataStart - in->position());
+
+      // let the output estimate its size from the log data size and the format of the first sector
+      if (status.sectorPos == 0) {
+        uint32_t sectors = ((in->filesize() + (SIZE_SECTOR - 1)) / SIZE_SECTOR);
+        out->estimateSize((in->filesize() - (sectors * SIZE_HEADER)), getRecordSize(), fmt);
+      }
     }
 
     // try to read the markers (special petterns such as a Dynamic Settings Patterm (DSP),
@@ -357,12 +435,12 @@ gpxinfo_t MtkParser::convert(File32 *input, File32 *output, void (*progressCallb
     }
 
     // close the track if the track mode is TRK_ONE_DAY and the current record is a new day
-    if ((options.trackMode == TRK_ONE_DAY) && (isDifferentDate(out->getLastTime(), rcd.time))) {
-      out->endTrack();
+    if ((options.trackMode == TRK_ONE_DAY) && (isDifferentDate(getLastTime(), rcd.time))) {
+      endTrack();
     }
 
     // write the record data as TRKPT
-    out->putTrkpt(rcd);
+    putTrkpt(rcd);
 
     // store the current record to write as a waypt if the putWaypts option is enabled and
     // the record is logged by user
@@ -380,12 +458,21 @@ gpxinfo_t MtkParser::convert(File32 *input, File32 *output, void (*progressCallb
   // call the progress callback function with the final values
   if (progressCallback != NULL) progressCallback(in->filesize(), in->filesize());
 
-  // get the GPX information before closing the output
-  gpxinfo_t gpxInfo = out->endGpx();
+  // write the pending TRKPT in the simplifier before closing the output
+  if (simplifier != NULL) {
+    simplifier->flush();
+    Serial.printf("Parser.convert: simplified [dropped=%d, tolerance=%.1fm]\n",  //
+                  simplifier->getDroppedCount(), options.simplifyTolerance);
+  }
+
+  // close the GPX data and get the information of all tracks before closing the output
+  out->endGpx();
+  gpxinfo_t gpxInfo = out->getTotalInfo();
 
   // close the input and output files
   delete in;
   delete out;
+  if (simplifier != NULL) delete simplifier;
 
   // print the finish message to the serial monitor
   Serial.printf("Parser.convert: finished [trk=%d, trkpt=%d, wpt=%d] (t=%d)\n",  //
@@ -0,0 +1,139 @@
+#include "MtkSession.h"
+
+/**
+ * @fn MtkSession::MtkSession(MtkLoggerTask *tsk, uint32_t idleTmo, uint32_t keepAliveIntv)
+ * @brief Constructor of MtkSession class. The link is not opened until open() is called.
+ * @param tsk A pointer to the MtkLoggerTask object running the jobs on the logger to keep the link of.
+ * @param idleTmo The time in milliseconds to close the link after the last operation.
+ * @param keepAliveIntv The interval in milliseconds to send the keepalives while the link is idle.
+ */
+MtkSession::MtkSession(MtkLoggerTask *tsk, uint32_t idleTmo, uint32_t keepAliveIntv) {
+  task = tsk;
+  memset(address, 0, sizeof(address));
+  idleTimeout = idleTmo;
+  keepAliveInterval = keepAliveIntv;
+  lastUsedAt = 0;
+  lastAliveAt = 0;
+  opened = false;
+}
+
+/**
+ * @fn bool MtkSession::isSameAddress(const uint8_t *addr)
+ * @brief Check if the given address is the address of the opened link.
+ * @param addr A pointer to the address (6 bytes) of the logger.
+ * @return Returns true if the addresses are the same, otherwise false.
+ */
+bool MtkSession::isSameAddress(const uint8_t *addr) {
+  return (memcmp(address, addr, sizeof(address)) == 0);
+}
+
+/**
+ * @fn bool MtkSession::runJob(uint32_t id)
+ * @brief Wait for a job queued to the logger task and get its result.
+ * @param id The id of the queued job (0 if the job could not be queued).
+ * @return Returns true if the job is completed successfully, otherwise false.
+ */
+bool MtkSession::runJob(uint32_t id) {
+  loggerjob_t job;
+
+  return ((task->waitForCompletion(id, &job, JOB_TIMEOUT)) && (job.result));
+}
+
+/**
+ * @fn bool MtkSession::reconnect()
+ * @brief Drop the current link (if any) and connect to the logger again. Retry the connection once if failed.
+ * @return Returns true if connected, otherwise false.
+ */
+bool MtkSession::reconnect() {
+  runJob(task->disconnect());
+  opened = false;
+
+  for (uint8_t i = 0; i < CONNECT_RETRIES; i++) {
+    if (runJob(task->connect(address))) {
+      opened = true;
+      lastUsedAt = millis();
+      lastAliveAt = lastUsedAt;
+      return true;
+    }
+
+    Serial.printf("Session.reconnect: failed to connect (try %d/%d)\n", (i + 1), CONNECT_RETRIES);
+  }
+
+  return false;
+}
+
+/**
+ * @fn bool MtkSession::open(const uint8_t *addr)
+ * @brief Get the link to the logger ready for an operation. The opened link is reused if the logger answers a
+ * keepalive, otherwise the logger is connected again.
+ * @param addr A pointer to the address (6 bytes) of the logger.
+ * @return Returns true if the link is ready, otherwise false.
+ */
+bool MtkSession::open(const uint8_t *addr) {
+  if ((opened) && (isSameAddress(addr)) && (task->connected())) {
+    if (runJob(task->keepAlive())) {
+      lastUsedAt = millis();
+      lastAliveAt = lastUsedAt;
+      Serial.printf("Session.open: reuse the link\n");
+      return true;
+    }
+
+    Serial.printf("Session.open: the link is not alive. reconnect\n");
+  }
+
+  memcpy(address, addr, sizeof(address));
+  return reconnect();
+}
+
+/**
+ * @fn void MtkSession::release()
+ * @brief End an operation on the link. The link is kept open for the next operation until the idle timeout (a link
+ * broken by the operation is detected and reconnected by the next open()).
+ */
+void MtkSession::release() {
+  lastUsedAt = millis();
+}
+
+/**
+ * @fn void MtkSession::close()
+ * @brief Close the link to the logger.
+ */
+void MtkSession::close() {
+  runJob(task->disconnect());
+  opened = false;
+}
+
+/**
+ * @fn void MtkSession::poll()
+ * @brief Keep the idle link alive or close it. Send a keepalive every keepAliveInterval and close the link after
+ * idleTimeout since the last operation. The link is also closed if the logger does not answer the keepalive.
+ */
+void MtkSession::poll() {
+  if (!opened) return;
+
+  uint32_t now = millis();
+
+  if (!task->connected()) {
+    Serial.printf("Session.poll: the link is dropped\n");
+    close();
+  } else if ((now - lastUsedAt) >= idleTimeout) {
+    Serial.printf("Session.poll: idle timeout\n");
+    close();
+  } else if ((now - lastAliveAt) >= keepAliveInterval) {
+    if (runJob(task->keepAlive())) {
+      lastAliveAt = millis();
+    } else {
+      Serial.printf("Session.poll: no reply to the keepalive\n");
+      close();
+    }
+  }
+}
+
+/**
+ * @fn bool MtkSession::isOpen()
+ * @brief Check if the link is kept open.
+ * @return Returns true if the link is open, otherwise false.
+ */
+bool MtkSession::isOpen() {
+  return ((opened) && (task->connected()));
+}
@@ -4,92 +4,56 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "HexDecoder.h"
+
 #define RB_CCNT_CHKSUM 100
-#define NON_HEXCHAR_VAL 255
+#define NON_HEXCHAR_VAL HEX_INVALID
 #define CHAR_CR '\r'
 #define CHAR_LF '\n'
 
 /**
  * @fn NmeaBuffer::NmeaBuffer()
  * @brief Constructor of NmeaBuffer class
- * @details This constructor initializes the NmeaBuffer object by allocating the buffer and clear it.
+ * @details This constructor initializes the NmeaBuffer object and clear the buffer.
  */
 NmeaBuffer::NmeaBuffer() {
   // constructor: initialize member variables
-  currentPage = allocatePage(&rootPage);
   clear();
 }
 
-/**
- * @fn NmeaBuffer::~NmeaBuffer()
- * @brief Destructor of NmeaBuffer class
- * @details This destructor releases all dynamically allocated pages in the buffer.
- */
-NmeaBuffer::~NmeaBuffer() {
-  // destuctor: release dynamically allocated buffer
-  freePages(rootPage);
-}
-
-/**
- * @fn void NmeaBuffer::freePages(bufferpage_t *pg)
- * @brief Release all pages from the given page to the last.
- * @param pg A pointer to the first page to release. If NULL is given, do nothing.
- * @details This function is used to release all pages in the buffer.
- */
-void NmeaBuffer::freePages(bufferpage_t *pg) {
-  // release all pages from the given to the last
-  // if NULL is given, do nothing
-  bufferpage_t *cp = pg;
-  while (cp != NULL) {
-    bufferpage_t *np = cp->next;
-    free(cp);
-    cp = np;
-  }
-}
-
-/**
- * @fn bufferpage_t *NmeaBuffer::allocatePage(bufferpage_t **pg)
- * @brief Allocate a new page and return its pointer.
- * @param pg A pointer to a pointer to the page. If it is not NULL, the new page is assigned to it.
- */
-bufferpage_t *NmeaBuffer::allocatePage(bufferpage_t **pg) {
-  // create a new page and fill it with zero
-  bufferpage_t *np = (bufferpage_t *)malloc(sizeof(bufferpage_t));
-  memset(np, 0, sizeof(bufferpage_t));
-
-  // assign the page to the given argment (if it is NOT NULL)
-  if (pg != NULL) *pg = np;
-
-  // return pointer of the new page
-  return np;
-}
-
 /**
  * @fn char *NmeaBuffer::getBuffer()
  * @brief Get the pointer to the buffer.
  * @return Returns a pointer to the buffer.
  */
 char *NmeaBuffer::getBuffer() {
-  return rootPage->buf;
+  return buf;
 }
 
 /**
  * @fn void NmeaBuffer::clear()
  * @brief Clear the buffer.
- * @details This function releases all pages except the first one and zero-fills the first page
+ * @details This function only resets the positions and terminates the buffer (O(1), no memory is released).
  */
 void NmeaBuffer::clear() {
-  // release second and subsequent pages, zero-fill the first page
-  freePages(rootPage->next);
-  memset(rootPage, 0, sizeof(bufferpage_t));
+  buf[0] = 0;
 
   // clear member variables
-  currentPage = rootPage;
   ptr = 0;
   dataLength = 0;
   columnCount = 0;
   expectedChecksum = 0;
   receivedChecksum = 0;
+  classifier.reset();
+}
+
+/**
+ * @fn nmeatype_t NmeaBuffer::getType()
+ * @brief Get the type of the sentence in the buffer, classified from its first fields while it is received.
+ * @return Returns the type of the sentence.
+ */
+nmeatype_t NmeaBuffer::getType() {
+  return classifier.getType();
 }
 
 /**
@@ -110,35 +74,22 @@ bool NmeaBuffer::isValidChar(char ch) {
  * @return Returns a byte value of the hexadecimal character. Returns 255 if the character is not a valid
  */
 uint8_t NmeaBuffer::hexCharToByte(char ch) {
-  switch (ch) {
-  case '0' ... '9':  // return 0-9 for '0'-'9'
-    return (ch - '0');
-  case 'a' ... 'f':  // return 10-16 for 'a'-'f'
-    return (ch - 'a' + 10);
-  case 'A' ... 'F':  // return 10-16 for 'A'-'F'
-    return (ch - 'A' + 10);
-  }
-
-  // return zero for others ([$*,\r\n] and others)
-  return NON_HEXCHAR_VAL;
+  // return NON_HEXCHAR_VAL for others ([$*,\r\n] and others)
+  return HexDecoder::value(ch);
 }
 
 /**
  * @fn void NmeaBuffer::appendToBuffer(char ch)
  * @brief Append a character to the buffer.
  * @param ch A character to append.
- * @details This function appends the given character to the current page of the buffer. If the current page is full,
- * it allocates a new page and set it as the current page.
+ * @details This function appends the given character to the buffer and keeps the buffer null-terminated. If the buffer
+ * is full, the character is discarded.
  */
 void NmeaBuffer::appendToBuffer(char ch) {
-  if (ptr < BP_BUFFER_SIZE) {
-    currentPage->buf[ptr] = ch;
-    ptr += 1;
-  }
-
-  if (ptr == BP_BUFFER_SIZE) {
-    currentPage = allocatePage(&(currentPage->next));
-    ptr = 0;
+  if (dataLength < NB_BUFFER_SIZE) {
+    buf[dataLength] = ch;
+    dataLength += 1;
+    buf[dataLength] = 0;
   }
 }
 
@@ -166,7 +117,8 @@ void NmeaBuffer::updateChecksum(char ch) {
  * @return Returns true if the character is a line feed ('\n', that means the end of the sentence) and the checksum is
  * valid, otherwise false.
  * @details This function puts the given character to the buffer. If the character is a line feed ('\n') and the
- * checksum is valid, it returns true. Otherwise, it returns false.
+ * checksum is valid, it returns true. Otherwise, it returns false. The sentences other than PMTK (GGA, RMC and so on)
+ * are dropped as soon as they are classified, and never buffered.
  */
 bool NmeaBuffer::put(char ch) {
   switch (ch) {
@@ -181,29 +133,24 @@ bool NmeaBuffer::put(char ch) {
     break;
   }
 
+  // classify the sentence from its first fields and drop it if it is not needed
+  if (classifier.put(ch) == NMEA_DROP) return false;
+
   if (isValidChar(ch)) {
     // append given char (when buffer available), then
     // calculate checksum of a receiving sentence or extract checksum value
     appendToBuffer(ch);
     updateChecksum(ch);
-
-    dataLength += 1;
   }
 
   return ((ch == CHAR_LF) && (expectedChecksum == receivedChecksum));
 }
 
 char NmeaBuffer::get() {
-  char ch = currentPage->buf[ptr];
-
-  if ((ch != 0) && (ptr < BP_BUFFER_SIZE)) {
-    ptr += 1;
+  char ch = buf[ptr];
 
-    if ((ptr == BP_BUFFER_SIZE) && (currentPage->next != NULL)) {
-      currentPage = currentPage->next;
-      ptr = 0;
-    }
-  }
+  // the buffer is null-terminated, so ptr never goes beyond dataLength
+  if (ch != 0) ptr += 1;
 
   return ch;
 }
@@ -265,37 +212,28 @@ bool NmeaBuffer::readHexByteHalf(byte *by) {
 }
 
 bool NmeaBuffer::match(const char *str) {
-  return (strstr(rootPage->buf, str) != NULL);
+  // the expected string is the prefix of the sentence (with or without the leading '$')
+  const char *sentence = ((str[0] == '$') || (buf[0] != '$')) ? buf : (buf + 1);
+  return (strncmp(sentence, str, strlen(str)) == 0);
 }
 
 bool NmeaBuffer::seekCurToColumn(uint8_t clm) {
-  bufferpage_t *pg = rootPage;
   uint16_t pt = 0;
-  uint16_t cc = 0;
-
-  while ((cc < clm) && (pg != NULL)) {
-    for (pt = 0; pt < BP_BUFFER_SIZE; pt++) {
-      if ((cc == clm) || (pg->buf[pt] == 0)) {
-        break;
-      }
-
-      switch (pg->buf[pt]) {
-      case ',':
-        cc += 1;
-        break;
-      case '*':
-        cc = RB_CCNT_CHKSUM;
-        break;
-      }
-    }
-
-    if (cc < clm) {
-      pg = pg->next;
+  uint8_t cc = 0;
+
+  while ((cc < clm) && (pt < dataLength)) {
+    switch (buf[pt]) {
+    case ',':
+      cc += 1;
+      break;
+    case '*':
+      cc = RB_CCNT_CHKSUM;
+      break;
     }
+    pt += 1;
   }
 
   if (cc == clm) {
-    currentPage = pg;
     ptr = pt;
     columnCount = cc;
   }
@@ -304,7 +242,7 @@ bool NmeaBuffer::seekCurToColumn(uint8_t clm) {
 }
 
 bool NmeaBuffer::seekCur(uint32_t sk) {
-  for (int i = 0; i < sk; i++) {
+  for (uint32_t i = 0; i < sk; i++) {
     if (get() == 0) return false;
   }
 
@@ -0,0 +1,86 @@
+#include "NmeaClassifier.h"
+
+// the prefixes of the sentences to classify ("$PMTK" matches the PMTK sentences not listed)
+const nmeaprefix_t NmeaClassifier::PREFIXES[] = {
+    {"$PMTK182,8,", 11, NMEA_DATA},    //
+    {"$PMTK182,3,", 11, NMEA_VALUE},   //
+    {"$PMTK001,", 9, NMEA_ACK},        //
+    {"$PMTK705,", 9, NMEA_RELEASE},    //
+    {"$PMTK010,", 9, NMEA_SYSMSG},     //
+    {"$PMTK", 5, NMEA_PMTK},           //
+};
+const uint8_t NmeaClassifier::PREFIX_COUNT = (sizeof(PREFIXES) / sizeof(nmeaprefix_t));
+
+/**
+ * @fn NmeaClassifier::NmeaClassifier()
+ * @brief Constructor of NmeaClassifier class. Reset the classifier state.
+ */
+NmeaClassifier::NmeaClassifier() {
+  reset();
+}
+
+/**
+ * @fn void NmeaClassifier::reset()
+ * @brief Start classifying a new sentence (call this before putting the leading '$').
+ */
+void NmeaClassifier::reset() {
+  candidates = (1 << PREFIX_COUNT) - 1;
+  pos = 0;
+  matched = NMEA_DROP;
+  type = NMEA_PENDING;
+}
+
+/**
+ * @fn nmeatype_t NmeaClassifier::put(char ch)
+ * @brief Put the next character of the sentence and narrow down the type.
+ * @param ch A character to put.
+ * @return Returns the type of the sentence, or NMEA_PENDING if it is not determined yet.
+ */
+nmeatype_t NmeaClassifier::put(char ch) {
+  if (type != NMEA_PENDING) return type;
+
+  // drop the prefixes not matching the character and remember the longest prefix completed
+  bool incomplete = false;
+  for (uint8_t i = 0; i < PREFIX_COUNT; i++) {
+    if (!(candidates & (1 << i))) continue;
+
+    if (PREFIXES[i].prefix[pos] != ch) {
+      candidates &= ~(1 << i);
+    } else if ((pos + 1) == PREFIXES[i].length) {
+      candidates &= ~(1 << i);
+      matched = PREFIXES[i].type;  // a prefix completed later is longer
+    } else {
+      incomplete = true;
+    }
+  }
+  pos += 1;
+
+  // the type is determined when no prefix is left to complete
+  if (!incomplete) type = matched;
+
+  return type;
+}
+
+/**
+ * @fn nmeatype_t NmeaClassifier::getType()
+ * @brief Get the type of the sentence being classified.
+ * @return Returns the type of the sentence, or NMEA_PENDING if it is not determined yet.
+ */
+nmeatype_t NmeaClassifier::getType() {
+  return type;
+}
+
+/**
+ * @fn nmeatype_t NmeaClassifier::classify(const char *str)
+ * @brief Classify the given string (a sentence or an expected reply prefix with or without the leading '$').
+ * @param str A string to classify.
+ * @return Returns the type of the string, or NMEA_PENDING if the string is too short to determine the type.
+ */
+nmeatype_t NmeaClassifier::classify(const char *str) {
+  NmeaClassifier cls;
+
+  if (str[0] != '$') cls.put('$');
+  for (uint8_t i = 0; (str[i] != 0) && (cls.getType() == NMEA_PENDING); i++) cls.put(str[i]);
+
+  return cls.getType();
+}
@@ -0,0 +1,122 @@
+#include "RxRingBuffer.h"
+
+/**
+ * @fn RxRingBuffer::RxRingBuffer(uint32_t capacity)
+ * @brief Constructor of RxRingBuffer class. Allocate the ring of the given capacity (rounded up to a power of 2).
+ * @param capacity The number of bytes the ring can hold.
+ */
+RxRingBuffer::RxRingBuffer(uint32_t capacity) {
+  size = 1;
+  while (size < capacity) size <<= 1;
+  mask = (size - 1);
+
+  buf = (uint8_t *)malloc(size);
+  head = 0;
+  tail = 0;
+  resetStats();
+}
+
+/**
+ * @fn RxRingBuffer::~RxRingBuffer()
+ * @brief Destructor of RxRingBuffer class. Release the ring.
+ */
+RxRingBuffer::~RxRingBuffer() {
+  free(buf);
+}
+
+/**
+ * @fn size_t RxRingBuffer::available()
+ * @brief Get the number of bytes in the ring (called from the consumer).
+ * @return Returns the number of bytes that can be popped.
+ */
+size_t RxRingBuffer::available() {
+  uint32_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+  return (h - tail);
+}
+
+/**
+ * @fn void RxRingBuffer::clear()
+ * @brief Discard all bytes in the ring (called from the consumer).
+ */
+void RxRingBuffer::clear() {
+  uint32_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+  __atomic_store_n(&tail, h, __ATOMIC_RELEASE);
+}
+
+/**
+ * @fn uint32_t RxRingBuffer::getHighWater()
+ * @brief Get the max number of bytes held in the ring since the last resetStats().
+ * @return Returns the high-water mark in bytes.
+ */
+uint32_t RxRingBuffer::getHighWater() {
+  return highWater;
+}
+
+/**
+ * @fn uint32_t RxRingBuffer::getOverflow()
+ * @brief Get the number of bytes discarded because the ring was full since the last resetStats().
+ * @return Returns the number of bytes lost.
+ */
+uint32_t RxRingBuffer::getOverflow() {
+  return overflow;
+}
+
+/**
+ * @fn size_t RxRingBuffer::pop(uint8_t *data, size_t len)
+ * @brief Take bytes from the ring (called from the consumer).
+ * @param data A pointer to the buffer to store the bytes.
+ * @param len The max number of bytes to take.
+ * @return Returns the number of bytes taken.
+ */
+size_t RxRingBuffer::pop(uint8_t *data, size_t len) {
+  uint32_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+  uint32_t t = tail;
+  uint32_t n = (h - t);
+  if (n > len) n = len;
+
+  // copy the bytes in up to two parts (before and after the wrap point)
+  uint32_t pos = (t & mask);
+  uint32_t first = ((size - pos) < n) ? (size - pos) : n;
+  memcpy(data, (buf + pos), first);
+  memcpy((data + first), buf, (n - first));
+
+  __atomic_store_n(&tail, (t + n), __ATOMIC_RELEASE);
+  return n;
+}
+
+/**
+ * @fn size_t RxRingBuffer::push(const uint8_t *data, size_t len)
+ * @brief Put bytes into the ring (called from the producer). The bytes that do not fit are discarded and counted.
+ * @param data A pointer to the bytes.
+ * @param len The number of bytes.
+ * @return Returns the number of bytes put.
+ */
+size_t RxRingBuffer::push(const uint8_t *data, size_t len) {
+  uint32_t t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+  uint32_t h = head;
+  uint32_t room = size - (h - t);
+  uint32_t n = (len < room) ? len : room;
+
+  // copy the bytes in up to two parts (before and after the wrap point)
+  uint32_t pos = (h & mask);
+  uint32_t first = ((size - pos) < n) ? (size - pos) : n;
+  memcpy((buf + pos), data, first);
+  memcpy(buf, (data + first), (n - first));
+
+  __atomic_store_n(&head, (h + n), __ATOMIC_RELEASE);
+
+  // update the statistics
+  if ((h + n - t) > highWater) highWater = (h + n - t);
+  if (n < len) overflow += (len - n);
+
+  return n;
+}
+
+/**
+ * @fn void RxRingBuffer::resetStats()
+ * @brief Clear the high-water mark and the overflow counter.
+ */
+void RxRingBuffer::resetStats() {
+  highWater = 0;
+  overflow = 0;
+}
@@ -0,0 +1,145 @@
+#include "TrackSimplifier.h"
+
+#include <math.h>
+
+/**
+ * @fn TrackSimplifier::TrackSimplifier(GpxFileWriter *output, float tol)
+ * @brief Constructor of the TrackSimplifier class. The simplifier is a streaming variant of the Douglas-Peucker
+ * algorithm (opening window method). A TRKPT is dropped if it is within the tolerance from the segment between the last
+ * written TRKPT and the following point. The number of pending TRKPTs is limited by SIMPLIFIER_WINDOW.
+ * @param output A pointer to the GPX writer to put the simplified TRKPTs.
+ * @param tol The maximum distance (in meters) from the simplified track to a dropped TRKPT.
+ */
+TrackSimplifier::TrackSimplifier(GpxFileWriter *output, float tol) {
+  out = output;
+  tolerance = tol;
+  count = 0;
+  dropCount = 0;
+}
+
+/**
+ * @fn bool TrackSimplifier::hasPosition(const gpsrecord_t *rcd)
+ * @brief Check if the given record has both of latitude and longitude.
+ */
+bool TrackSimplifier::hasPosition(const gpsrecord_t *rcd) {
+  return ((rcd->format & FMT_LAT) && (rcd->format & FMT_LON));
+}
+
+/**
+ * @fn float TrackSimplifier::distanceToSegment(const gpsrecord_t *p, const gpsrecord_t *a, const gpsrecord_t *b)
+ * @brief Calculate the distance from the point p to the segment a-b. The positions are projected to a local plane
+ * (equirectangular projection) around the point a, which is accurate enough for the short segments of a track.
+ * @return Returns the distance in meters.
+ */
+float TrackSimplifier::distanceToSegment(const gpsrecord_t *p, const gpsrecord_t *a, const gpsrecord_t *b) {
+  const float RAD_PER_DEG = (M_PI / 180.0);
+
+  // project the points to the local plane in meters (origin: point a)
+  float ky = (EARTH_RADIUS * RAD_PER_DEG);
+  float kx = ky * cosf((float)a->latitude * RAD_PER_DEG);
+  float bx = (float)(b->longitude - a->longitude) * kx;
+  float by = (float)(b->latitude - a->latitude) * ky;
+  float px = (float)(p->longitude - a->longitude) * kx;
+  float py = (float)(p->latitude - a->latitude) * ky;
+
+  // find the nearest position on the segment (clamped to the end points)
+  float len2 = (bx * bx) + (by * by);
+  float t = (len2 > 0) ? (((px * bx) + (py * by)) / len2) : 0;
+  t = (t < 0) ? 0 : (t > 1) ? 1 : t;
+
+  float dx = px - (t * bx);
+  float dy = py - (t * by);
+
+  return sqrtf((dx * dx) + (dy * dy));
+}
+
+/**
+ * @fn bool TrackSimplifier::isWithinTolerance(const gpsrecord_t *rcd)
+ * @brief Check if all pending TRKPTs are within the tolerance from the segment between the anchor (the last written
+ * TRKPT) and the given record.
+ */
+bool TrackSimplifier::isWithinTolerance(const gpsrecord_t *rcd) {
+  for (uint8_t i = 1; i < count; i++) {
+    if (distanceToSegment(&window[i], &window[0], rcd) > tolerance) return false;
+  }
+
+  return true;
+}
+
+/**
+ * @fn void TrackSimplifier::putTrkpt(gpsrecord_t rcd)
+ * @brief Put a TRKPT to the simplifier. The TRKPT is kept pending until it is determined whether it is needed to
+ * represent the track shape or not. Only the needed TRKPTs are written to the GPX writer.
+ * @param rcd A gpsrecord_t structure that contains the TRKPT to put.
+ */
+void TrackSimplifier::putTrkpt(gpsrecord_t rcd) {
+  // records without a position cannot be simplified. write it as it is.
+  if (!hasPosition(&rcd)) {
+    flush();
+    out->putTrkpt(rcd);
+    return;
+  }
+
+  // the first TRKPT in a track is always written and becomes the anchor
+  if (count == 0) {
+    out->putTrkpt(rcd);
+    window[0] = rcd;
+    count = 1;
+    return;
+  }
+
+  // keep the new record pending if the pending TRKPTs can be represented by the segment
+  // between the anchor and the new record
+  if ((count < SIMPLIFIER_WINDOW) && (isWithinTolerance(&rcd))) {
+    window[count] = rcd;
+    count += 1;
+    return;
+  }
+
+  // otherwise, write the last pending TRKPT and use it as the new anchor
+  // (the TRKPTs between the anchor and the last one are dropped)
+  out->putTrkpt(window[count - 1]);
+  dropCount += (count - 2);
+  window[0] = window[count - 1];
+  window[1] = rcd;
+  count = 2;
+}
+
+/**
+ * @fn void TrackSimplifier::flush()
+ * @brief Write the last pending TRKPT to the GPX writer and reset the simplifier. This should be called at the end of
+ * a track to keep the end point of the track.
+ */
+void TrackSimplifier::flush() {
+  if (count > 1) {
+    out->putTrkpt(window[count - 1]);
+    dropCount += (count - 2);
+  }
+
+  count = 0;
+}
+
+/**
+ * @fn void TrackSimplifier::endTrack()
+ * @brief Write the pending TRKPT and close the current track of the GPX writer.
+ */
+void TrackSimplifier::endTrack() {
+  flush();
+  out->endTrack();
+}
+
+/**
+ * @fn uint32_t TrackSimplifier::getDroppedCount()
+ * @brief Return the number of TRKPTs dropped by the simplifier.
+ */
+uint32_t TrackSimplifier::getDroppedCount() {
+  return dropCount;
+}
+
+/**
+ * @fn uint32_t TrackSimplifier::getLastTime()
+ * @brief Return the timestamp of the last TRKPT put to the simplifier (including the pending TRKPTs).
+ */
+uint32_t TrackSimplifier::getLastTime() {
+  return (count > 0) ? window[count - 1].time : out->getLastTime();
+}
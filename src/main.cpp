@@ -4,6 +4,8 @@
 
 #include "AppUI.h"
 #include "MtkLogger.h"
+#include "MtkLoggerTask.h"
+#include "MtkSession.h"
 #include "MtkParser.h"
 #include "Resources.h"
 
@@ -14,6 +16,7 @@
 #define CPU_FREQ_LOW 80           // 80 MHz
 #define CPU_FREQ_HIGH 240         // 240 MHz
 #define SD_ACCESS_SPEED 15000000  // 15 MHz (note: over 15Mhz may cause I/O errors)
+#define LOGGER_POLL_INTERVAL 100  // 100 msec to update the progress of a logger job
 
 #define BEEP_VOLUME 1            // beep volume level (range: 1-10)
 #define BEEP_FREQ_SUCCESS 4186   // 4186 Hz (C8) for success beep sound
@@ -27,6 +30,10 @@
 
 #define TEMP_BIN_NAME "download.bin"  // filename for download cache
 #define TEMP_GPX_NAME "download.gpx"  // filename for converting data (before rename)
+#define TEMP_JSON_NAME "download.json"  // filename for track statistics (before rename)
+#define TEMP_IDX_NAME "download.idx"  // filename for the sector hashes of download cache
+#define CAPTURE_NAME "capture.bin"    // filename for the raw SPP session of the last download
+#define TEMP_LATEST_NAME "latest.bin"  // filename for the newest sector of download cache (newest only mode)
 
 typedef struct _logmodeset {
   uint8_t distIdx;
@@ -41,9 +48,15 @@ typedef struct _appconfig {
   uint8_t loggerAddr[BT_ADDR_LEN];  // app / address of paired logger
   char loggerName[DEV_NAME_LEN];    // app / name of pairded logger
   bool playBeep;                    // app / play beep sound
+  bool captureSession;              // app / capture the raw SPP session of downloads
+  bool latestOnly;                  // app / download and convert only the sector holding the newest data
   trackmode_t trackMode;            // parser / how to divide/put tracks
   uint8_t timeOffsetIdx;            // parser / timezone offset in hours
   bool putWaypt;                    // parser / treat points recorded by button as WPTs
+  bool compressGpx;                 // parser / save GPX files as gzip (.gpx.gz)
+  uint8_t simplifyIdx;              // parser / tolerance to drop redundant TRKPTs
+  bool splitFiles;                  // parser / save each track as a separate GPX file
+  bool saveStats;                   // parser / save track statistics as a JSON sidecar (.json)
   logmodeset_t logMode1;            // log mode #1 / auto log criterias
   logmodeset_t logMode2;            // log mode #2 / auto log criterias
   uint32_t logFormat;               // log format / what fields to be recorded
@@ -58,7 +71,8 @@ bool isSDcardAvailable();
 bool isSameBytes(const void*, const void*, uint16_t);
 uint32_t switchBitFlags(uint32_t*, uint32_t);
 void playBeep(bool, uint16_t);
-uint16_t makeNewFileName(char*, char*, uint32_t);
+uint16_t makeFilename(char*, time_t);
+void saveStatsFile(const char*);
 void updateAppHint();
 char* setBoolDescr(char*, bool, size_t);
 
@@ -72,8 +86,12 @@ bool runSetLogMode(logmodeset_t*);
 
 /* system event handler */
 void onAppInputIdle();
+void onAppPoll();
 void onBTStatusUpdate(esp_spp_cb_event_t, esp_spp_cb_param_t*);
 void onProgressUpdate(int32_t, int32_t);
+void onLoggerProgress(int32_t, int32_t);
+bool waitForLoggerJob(uint32_t, loggerjob_t*, bool);
+void onGpxFileRollover(File32*, File32*, gpxinfo_t);
 
 // menu item event handlers
 void onDownloadLogSelect(iconmenu_t*);
@@ -97,6 +115,14 @@ void timezoneOnSelect(textmenu_t*);
 void timezoneGetValText(textmenu_t*, char*, size_t);
 void putWayptOnSelect(textmenu_t*);
 void putWayptGetValText(textmenu_t*, char*, size_t);
+void compressGpxOnSelect(textmenu_t*);
+void compressGpxGetValText(textmenu_t*, char*, size_t);
+void simplifyOnSelect(textmenu_t*);
+void simplifyGetValText(textmenu_t*, char*, size_t);
+void splitFilesOnSelect(textmenu_t*);
+void splitFilesGetValText(textmenu_t*, char*, size_t);
+void saveStatsOnSelect(textmenu_t*);
+void saveStatsGetValText(textmenu_t*, char*, size_t);
 
 /* Event handlers for log mode preset menus */
 void logByDistOnSelect(textmenu_t*);
@@ -143,19 +169,31 @@ void logMode2SubMenuOnSelect(textmenu_t*);
 void logFormatSubMenuOnSelect(textmenu_t*);
 void enableBeepOnSelect(textmenu_t*);
 void enableBeepGetValText(textmenu_t*, char*, size_t);
+void captureSessionOnSelect(textmenu_t*);
+void captureSessionGetValText(textmenu_t*, char*, size_t);
+void latestOnlyOnSelect(textmenu_t*);
+void latestOnlyGetValText(textmenu_t*, char*, size_t);
 void clearCacheFileOnSelect(textmenu_t*);
 void performFormatOnSelect(textmenu_t*);
 void clearSettingsOnSelect(textmenu_t*);
 
 // device settings
-const char* APP_NAME = "SmallStep";    // application title
-const char LCD_BRIGHTNESS = 10;        // LCD brightness (up to 255)
-const uint32_t IDLE_TIMEOUT = 120000;  // idle time for auto power-off in msec
+const char* APP_NAME = "SmallStep";         // application title
+const char LCD_BRIGHTNESS = 10;             // LCD brightness (up to 255)
+const uint32_t IDLE_TIMEOUT = 120000;       // idle time for auto power-off in msec
+const uint32_t SESSION_TIMEOUT = 60000;     // idle time to close the link to the logger in msec
+const uint32_t KEEPALIVE_INTERVAL = 10000;  // interval of the keepalives on the idle link in msec
+const uint32_t DISCOVER_TIMEOUT = 10240;    // duration of the inquiry scan to discover the logger in msec
+
+// device names of the supported loggers (a trailing '*' matches any suffix; the earlier entry is preferred)
+const char* LOGGER_NAMES[] = {LOGGER_747PRO, LOGGER_M241, "HOLUX_M-1000*", "HOLUX_M-1200*", "HOLUX*", "i-Blue*",
+                              "iBT-GPS*",    "Qstarz*",   "BT-Q*",         "747*",          "737*"};
 
 // configuration value lists
 const float TIME_OFFSET_VALUES[] = {
     -12, -11, -10, -9, -8,  -7, -6,  -5, -4.5, -4, -3.5, -3, -2,  -1, 0,  1,
     2,   3,   3.5, 4,  4.5, 5,  5.5, 6,  6.5,  7,  8,    9,  9.5, 10, 12, 13};                       // uint: hours
+const float SIMPLIFY_VALUES[] = {0, 1, 2, 5, 10, 20};                                                // unit: meters
 const int16_t LOG_DIST_VALUES[] = {0, 100, 300, 500, 1000, 2000, 3000, 5000};                        // uint: .1 meters
 const int16_t LOG_TIME_VALUES[] = {0, 2, 5, 10, 30, 50, 100, 150, 200, 300, 600, 1200, 1800, 3000};  // unit: .1 seconds
 const int16_t LOG_SPEED_VALUES[] = {0,   100,  200,  300,  400,  500,  600,  700,  800,              // uint: .1 km/h
@@ -165,7 +203,11 @@ const int16_t LOG_SPEED_VALUES[] = {0,   100,  200,  300,  400,  500,  600,  700
 AppUI ui = AppUI();
 SdFat SDcard;
 MtkLogger logger = MtkLogger(APP_NAME);
+MtkLoggerTask loggerTask = MtkLoggerTask(&logger);
+MtkSession session = MtkSession(&loggerTask, SESSION_TIMEOUT, KEEPALIVE_INTERVAL);
+volatile int32_t loggerProgress[2];  // progress of the logger job (current, max; updated on the logger task)
 appconfig_t cfg;
+uint16_t gpxFileCount;  // number of GPX files saved in the split mode
 // uint32_t idleTimer;
 
 // the default configuration
@@ -175,9 +217,15 @@ const appconfig_t DEFAULT_CONFIG = {
     {0, 0, 0, 0, 0, 0},   // loggerAddr
     LOGGER_NONE,          // loggerName
     true,                 // playBeep
+    false,                // captureSession
+    false,                // latestOnly
     TRK_ONE_DAY,          // trackMode
     14,                   // timeOffsetIdx (14 -> UTC+0)
     true,                 // putWaypt
+    false,                // compressGpx
+    0,                    // simplifyIdx (0 -> disabled)
+    false,                // splitFiles
+    false,                // saveStats
     {0, 7, 0, true},      // logMode1 {distIdx, timeIdx (7 -> 15sec), speedIdx, fullStop}
     {0, 5, 0, true},      // logMode2 {distIdx, timeIdx (5 -> 5sec), speedIdx, fullStop}
     (FMT_FIXONLY | FMT_TIME | FMT_LON | FMT_LAT | FMT_HEIGHT | FMT_SPEED | FMT_RCR)  // logFormat
@@ -214,6 +262,14 @@ textmenu_t cfgOutput[] = {
      &timezoneGetValText, &timezoneOnSelect, &cfg.timeOffsetIdx},           //
     {true, "Put WAYPTs", "Record manual recorded points as WAYPTs (POIs)",  //
      &putWayptGetValText, &putWayptOnSelect, &cfg.putWaypt},                //
+    {true, "Compress GPX", "Save GPX files as gzip (.gpx.gz)",              //
+     &compressGpxGetValText, &compressGpxOnSelect, &cfg.compressGpx},       //
+    {true, "Simplify tracks", "Drop TRKPTs within the tolerance from track",  //
+     &simplifyGetValText, &simplifyOnSelect, &cfg.simplifyIdx},               //
+    {true, "Split files", "Save each track as a separate GPX file",             //
+     &splitFilesGetValText, &splitFilesOnSelect, &cfg.splitFiles},              //
+    {true, "Save statistics", "Save track statistics as JSON (.json)",          //
+     &saveStatsGetValText, &saveStatsOnSelect, &cfg.saveStats},                 //
 };
 
 // log mode settings menu #1
@@ -296,6 +352,10 @@ textmenu_t cfgMain[] = {
      &openSubMenuGetValText, &logFormatSubMenuOnSelect, NULL},
     {true, "Beep sound", "Play beep sound when a task is finished",  //
      &enableBeepGetValText, &enableBeepOnSelect, NULL},
+    {true, "Capture session", "Save raw logger data of downloads to SD",  //
+     &captureSessionGetValText, &captureSessionOnSelect, NULL},
+    {true, "Newest log only", "Download only the latest sector of log",  //
+     &latestOnlyGetValText, &latestOnlyOnSelect, NULL},
     {false, "----", "", NULL, NULL, NULL},
     {true, "Format SD card", "Format the inserted SD card",  //
      NULL, &performFormatOnSelect, NULL},
@@ -348,6 +408,50 @@ void onProgressUpdate(int32_t current, int32_t max) {
   ui.drawDialogProgress(current, max);
 }
 
+void onLoggerProgress(int32_t current, int32_t max) {
+  // called on the logger task. only store the progress (it is drawn by waitForLoggerJob())
+  loggerProgress[0] = current;
+  loggerProgress[1] = max;
+}
+
+bool waitForLoggerJob(uint32_t jobId, loggerjob_t* job, bool showProgress) {
+  // the job could not be queued
+  if (jobId == 0) return false;
+
+  // draw the progress on this task while the logger task is waiting for the replies,
+  // so drawing the screen does not delay the reception
+  int32_t drawn = -1;
+  while (!loggerTask.waitForCompletion(jobId, job, LOGGER_POLL_INTERVAL)) {
+    if ((!showProgress) || (loggerProgress[0] == drawn)) continue;
+
+    drawn = loggerProgress[0];
+    ui.drawDialogProgress(drawn, loggerProgress[1]);
+  }
+  if (showProgress) ui.drawDialogProgress(loggerProgress[0], loggerProgress[1]);
+
+  return job->result;
+}
+
+void onGpxFileRollover(File32* gpxFile, File32* jsonFile, gpxinfo_t gpxInfo) {
+  // close the finished GPX file (and its statistics) and save it with a unique name
+  gpxFile->close();
+  if (jsonFile != NULL) jsonFile->close();
+
+  if (gpxInfo.trkptCount > 0) {
+    char gpxName[40];
+    makeFilename(gpxName, gpxInfo.startTime);
+    SDcard.rename(TEMP_GPX_NAME, gpxName);
+    if (jsonFile != NULL) saveStatsFile(gpxName);
+    gpxFileCount += 1;
+
+    Serial.printf("SmallStep.onRollover: saved %s\n", gpxName);
+  }
+
+  // re-open the temporary files for the next track
+  *gpxFile = SDcard.open(TEMP_GPX_NAME, (O_CREAT | O_RDWR | O_TRUNC));
+  if (jsonFile != NULL) *jsonFile = SDcard.open(TEMP_JSON_NAME, (O_CREAT | O_RDWR | O_TRUNC));
+}
+
 bool isZeroedBytes(void* p, uint16_t size) {
   uint8_t* pb = (uint8_t*)p;
 
@@ -394,10 +498,10 @@ bool isSDcardAvailable() {
 }
 
 bool connectLogger(uint8_t msgLine) {
-  // connect to the logger
+  // connect to the logger (or reuse the link kept open by the last operation)
   ui.drawDialogText(BLUE, (msgLine + 0), "Connecting to GPS logger...");
 
-  if (!logger.connect(cfg.loggerAddr)) {
+  if (!session.open(cfg.loggerAddr)) {
     ui.drawDialogText(RED, (msgLine + 0), "Connecting to GPS logger... failed.");
     ui.drawDialogText(RED, (msgLine + 1), "- Make sure BT is enabled on the GPS logger");
     ui.drawDialogText(RED, (msgLine + 2), "- If this problem occurs repeatly, please re-");
@@ -426,8 +530,9 @@ uint16_t makeFilename(char* gpxName, time_t startTime) {
           ltime->tm_sec);           // sec (0-59)
 
   // Determine a unique file name
+  const char* ext = (cfg.compressGpx) ? "gpx.gz" : "gpx";
   for (uint16_t i = 1; i <= 65535; i++) {
-    sprintf(gpxName, "%s_%02d.gpx", baseName, i);
+    sprintf(gpxName, "%s_%02d.%s", baseName, i, ext);
 
     if (!SDcard.exists(gpxName)) return i;
   }
@@ -435,6 +540,21 @@ uint16_t makeFilename(char* gpxName, time_t startTime) {
   return -1;
 }
 
+void saveStatsFile(const char* gpxName) {
+  char jsonName[40];
+
+  // make the sidecar name from the GPX file name (e.g. "gps_xxx_01.gpx.gz" -> "gps_xxx_01.json")
+  strncpy(jsonName, gpxName, sizeof(jsonName) - 6);
+  jsonName[sizeof(jsonName) - 6] = '\0';
+  char* ext = strchr(jsonName, '.');
+  if (ext != NULL) *ext = '\0';
+  strcat(jsonName, ".json");
+
+  // replace the stale sidecar (left after its GPX file was deleted) if exists
+  if (SDcard.exists(jsonName)) SDcard.remove(jsonName);
+  SDcard.rename(TEMP_JSON_NAME, jsonName);
+}
+
 bool runDownloadLog() {
   // return false if the logger is not paired yet
   if (!isLoggerPaired()) return false;
@@ -446,9 +566,14 @@ bool runDownloadLog() {
 
   File32 binFile = SDcard.open(TEMP_BIN_NAME, (O_CREAT | O_RDWR));
   File32 gpxFile = SDcard.open(TEMP_GPX_NAME, (O_CREAT | O_RDWR | O_TRUNC));
-  if ((!binFile) || (!gpxFile)) {
+  File32 idxFile = SDcard.open(TEMP_IDX_NAME, (O_CREAT | O_RDWR));
+  File32 latFile;
+  if (cfg.latestOnly) latFile = SDcard.open(TEMP_LATEST_NAME, (O_CREAT | O_RDWR | O_TRUNC));
+  if ((!binFile) || (!gpxFile) || (!idxFile) || ((cfg.latestOnly) && (!latFile))) {
     if (binFile) binFile.close();
     if (gpxFile) gpxFile.close();
+    if (idxFile) idxFile.close();
+    if (latFile) latFile.close();
 
     ui.drawDialogText(RED, 0, "Could not open temporally files.");
     return false;
@@ -458,9 +583,29 @@ bool runDownloadLog() {
 
   ui.drawDialogText(BLUE, 1, "Downloading log data...");
   {
-    if (!logger.downloadLogData(&binFile, &onProgressUpdate)) {
+    // capture the raw SPP session of the download if enabled (kept also when the download is failed)
+    File32 capFile;
+    if (cfg.captureSession) capFile = SDcard.open(CAPTURE_NAME, (O_CREAT | O_RDWR | O_TRUNC));
+    if (capFile) logger.setCaptureFile(&capFile);
+
+    // in the newest only mode, only the sector holding the newest data is downloaded (into the cache) and copied to
+    // the latest file to be converted alone
+    loggerjob_t job;
+    memset((void*)loggerProgress, 0, sizeof(loggerProgress));
+    uint32_t jobId = (cfg.latestOnly) ? loggerTask.downloadLatestData(&binFile, &latFile, &onLoggerProgress, &idxFile)
+                                      : loggerTask.downloadLogData(&binFile, &onLoggerProgress, &idxFile);
+    bool result = waitForLoggerJob(jobId, &job, true);
+
+    if (capFile) {
+      logger.setCaptureFile(NULL);
+      capFile.close();
+    }
+
+    if (!result) {
       binFile.close();
       gpxFile.close();
+      idxFile.close();
+      if (latFile) latFile.close();
 
       ui.drawDialogText(RED, 1, "Downloading log data... failed.");
       ui.drawDialogText(RED, 2, "- Keep your logger close to this device");
@@ -468,10 +613,15 @@ bool runDownloadLog() {
       return false;
     }
 
-    // disconnect from the logger and close the downloaded data file
-    logger.disconnect();
+    // close the index of the downloaded data file (the link is kept open for the next operation)
+    idxFile.close();
   }
-  ui.drawDialogText(BLACK, 1, "Downloading log data... done.");
+  // print the result with the throughput of the download
+  dlstats_t dlStats = logger.getDownloadStats();
+  char donestr[48];
+  sprintf(donestr, "Downloading log data... done. (%d.%d KB/s)",  //
+          (dlStats.rateAvg / 1024), ((dlStats.rateAvg % 1024) * 10 / 1024));
+  ui.drawDialogText(BLACK, 1, donestr);
 
   ui.drawDialogText(BLUE, 2, "Converting data to GPX file...");
   {
@@ -479,9 +629,17 @@ bool runDownloadLog() {
     setCpuFrequencyMhz(CPU_FREQ_HIGH);
 
     // convert the binary file to GPX file and get the summary
-    parseopt_t parseopt = {cfg.trackMode, TIME_OFFSET_VALUES[cfg.timeOffsetIdx], cfg.putWaypt};
+    // (in the split mode, each track is saved by onGpxFileRollover() as soon as it is finished)
+    bool splitFiles = ((cfg.splitFiles) && (cfg.trackMode != TRK_SINGLE));
+    parseopt_t parseopt = {cfg.trackMode, TIME_OFFSET_VALUES[cfg.timeOffsetIdx], cfg.putWaypt, cfg.compressGpx,
+                           SIMPLIFY_VALUES[cfg.simplifyIdx]};
     MtkParser* parser = new MtkParser(parseopt);
-    gpxinfo_t gpxInfo = parser->convert(&binFile, &gpxFile, &onProgressUpdate);
+    gpxFileCount = 0;
+    File32 jsonFile;
+    if (cfg.saveStats) jsonFile = SDcard.open(TEMP_JSON_NAME, (O_CREAT | O_RDWR | O_TRUNC));
+    File32* srcFile = (cfg.latestOnly) ? &latFile : &binFile;
+    gpxinfo_t gpxInfo = parser->convert(srcFile, &gpxFile, &onProgressUpdate,  //
+                                        (splitFiles) ? &onGpxFileRollover : NULL, (jsonFile) ? &jsonFile : NULL);
     delete parser;
 
     // reset CPU freq. to 80 MHz
@@ -490,17 +648,27 @@ bool runDownloadLog() {
     // close the GPX file before rename and rename to the output file name
     binFile.close();
     gpxFile.close();
-
-    // make a unique name for the GPX file
-    char gpxName[32];
-    makeFilename(gpxName, gpxInfo.startTime);
+    if (latFile) latFile.close();
+    if (jsonFile) jsonFile.close();
 
     if (gpxInfo.trackCount > 0) {
-      SDcard.rename(TEMP_GPX_NAME, gpxName);
+      char outputstr[48], summarystr[48];
+
+      if (splitFiles) {
+        // all tracks are already saved. remove the temporary file left empty
+        SDcard.remove(TEMP_GPX_NAME);
+        if (SDcard.exists(TEMP_JSON_NAME)) SDcard.remove(TEMP_JSON_NAME);
+        sprintf(outputstr, "Output files : %d GPX files", gpxFileCount);
+      } else {
+        // make a unique name for the GPX file
+        char gpxName[40];
+        makeFilename(gpxName, gpxInfo.startTime);
+        SDcard.rename(TEMP_GPX_NAME, gpxName);
+        if (cfg.saveStats) saveStatsFile(gpxName);
+        sprintf(outputstr, "Output file : %s", gpxName);
+      }
 
       // make the output message strings
-      char outputstr[48], summarystr[48];
-      sprintf(outputstr, "Output file : %s", gpxName);
       sprintf(summarystr, "Summary : %d TRKs, %d TRKPTs, %d WPTs",  //
               gpxInfo.trackCount, gpxInfo.trkptCount, gpxInfo.wayptCount);
 
@@ -509,6 +677,8 @@ bool runDownloadLog() {
       ui.drawDialogText(BLUE, 3, outputstr);
       ui.drawDialogText(BLUE, 4, summarystr);
     } else {
+      if (SDcard.exists(TEMP_JSON_NAME)) SDcard.remove(TEMP_JSON_NAME);
+
       // print the result message
       ui.drawDialogText(BLACK, 2, "Converting data to GPX file... done.");
       ui.drawDialogText(BLUE, 3, "No output file is saved because of there is");
@@ -521,16 +691,22 @@ bool runDownloadLog() {
 
 void onAppInputIdle() {
   Serial.printf("SmallStep.onIdle: idle shutdown (t=%d)\n", millis());
+  session.close();
   SDcard.end();
   M5.Power.powerOFF();
 }
 
+void onAppPoll() {
+  // keep the link to the logger alive while waiting for input, and close it after the session timeout
+  if (!loggerTask.busy()) session.poll();
+}
+
 /**
  *
  */
 void onDownloadLogSelect(iconmenu_t* item) {
   bool result = runDownloadLog();
-  logger.disconnect();
+  session.release();
 
   playBeep(result, BEEP_DURATION_LONG);
   ui.promptOk();
@@ -549,7 +725,8 @@ bool runFixRTCtime() {
 
   ui.drawDialogText(BLUE, 1, "Setting RTC datetime...");
   {
-    if (!logger.fixRTCdatetime()) {
+    loggerjob_t job;
+    if (!waitForLoggerJob(loggerTask.fixRTCdatetime(), &job, false)) {
       ui.drawDialogText(RED, 1, "Setting RTC datetime... failed.");
       ui.drawDialogText(RED, 2, "- Keep GPS logger close to this device");
       return false;
@@ -567,7 +744,7 @@ bool runFixRTCtime() {
  */
 void onFixRTCtimeSelect(iconmenu_t* item) {
   bool result = runFixRTCtime();
-  logger.disconnect();
+  session.release();
 
   playBeep(result, BEEP_DURATION_LONG);
   ui.promptOk();
@@ -580,60 +757,56 @@ void onShowLocationSelect(iconmenu_t* item) {
 }
 
 bool runPairWithLogger() {
-  const String DEVICE_NAMES[] = {LOGGER_747PRO, LOGGER_M241};
-  const int8_t DEVICE_COUNT = 2;
-
   // draw a message dialog frame and clear the navigation bar
   ui.drawDialogFrame("Pair with Logger");
   ui.drawNavBar(NULL);  // disable the navigation bar
 
   ui.drawDialogText(BLUE, 0, "Discovering GPS logger...");
+  session.close();  // the inquiry scan needs the link closed
+
+  // run an inquiry scan and match the found devices against the name table at once
+  uint8_t addr[BT_ADDR_LEN];
+  char name[DEV_NAME_LEN];
+  int8_t devCount = (sizeof(LOGGER_NAMES) / sizeof(LOGGER_NAMES[0]));
+  if (logger.discover(LOGGER_NAMES, devCount, addr, name, DEV_NAME_LEN, DISCOVER_TIMEOUT) < 0) {
+    // print the failure message
+    ui.drawDialogText(BLACK, 0, "Discovering GPS logger... failed.");
+    ui.drawDialogText(RED, 1, "Cannot discover any supported logger.");
+    ui.drawDialogText(RED, 2, "- If this problem occurs repeatly, please re-");
+    ui.drawDialogText(RED, 3, "  start the logger and SmallStep");
+    return false;
+  }
 
-  for (int i = 0; i < DEVICE_COUNT; i++) {
-    // print the device name trying to connect
-    char msgbuf1[48], msgbuf2[48];
-    sprintf(msgbuf1, "- %s", DEVICE_NAMES[i].c_str());
-    ui.drawDialogText(BLUE, (1 + i), msgbuf1);
-
-    if (logger.connect(DEVICE_NAMES[i])) {  // successfully connected
-      logger.disconnect();                  // disconnect
-
-      // Note: bluetoothCallback is called when the device is connected
-      // and the logger address is set to the configuration before running below code
-
-      // set the logger model name to the configuration
-      strncpy(cfg.loggerName, DEVICE_NAMES[i].c_str(), (DEV_NAME_LEN - 1));
-
-      // print the success message
-      sprintf(msgbuf1, "- %s : found.", DEVICE_NAMES[i].c_str());
-      sprintf(msgbuf2, "Logger address : %02X%02X-%02X%02X-%02X%02X", cfg.loggerAddr[0], cfg.loggerAddr[1],
-              cfg.loggerAddr[2], cfg.loggerAddr[3], cfg.loggerAddr[4], cfg.loggerAddr[5]);
-      ui.drawDialogText(BLACK, 0, "Discovering GPS logger... done");
-      ui.drawDialogText(BLACK, (1 + i), msgbuf1);
-      ui.drawDialogText(BLUE, (2 + i), "Successfully paired with the discovered logger.");
-      ui.drawDialogText(BLUE, (3 + i), msgbuf2);
-
-      // update GUI
-      updateAppHint();
-      ui.drawTitleBar();
-
-      // save the app configuration
-      saveAppConfig();
-      return true;
-    } else {  // failed to connect to the device
-      sprintf(msgbuf1, "- %s : not found.", DEVICE_NAMES[i].c_str());
-      ui.drawDialogText(BLACK, (1 + i), msgbuf1);
-      continue;
-    }
+  char msgbuf1[48], msgbuf2[48];
+  sprintf(msgbuf1, "- %s : found.", name);
+  ui.drawDialogText(BLACK, 0, "Discovering GPS logger... done");
+  ui.drawDialogText(BLACK, 1, msgbuf1);
+
+  // connect to the found logger by its address (the link is kept open for the next operation)
+  if (!session.open(addr)) {
+    ui.drawDialogText(RED, 2, "Cannot connect to the discovered logger.");
+    ui.drawDialogText(RED, 3, "- Make sure BT is enabled on the GPS logger");
+    return false;
   }
+  session.release();
+
+  // set the logger address and name to the configuration
+  memcpy(cfg.loggerAddr, addr, BT_ADDR_LEN);
+  strncpy(cfg.loggerName, name, (DEV_NAME_LEN - 1));
 
-  // print the failure message
-  ui.drawDialogText(BLACK, 0, "Discovering GPS logger... failed.");
-  ui.drawDialogText(RED, (1 + DEVICE_COUNT), "Cannot discover any supported logger.");
-  ui.drawDialogText(RED, (2 + DEVICE_COUNT), "- If this problem occurs repeatly, please re-");
-  ui.drawDialogText(RED, (3 + DEVICE_COUNT), "  start the logger and SmallStep");
+  // print the success message
+  sprintf(msgbuf2, "Logger address : %02X%02X-%02X%02X-%02X%02X", cfg.loggerAddr[0], cfg.loggerAddr[1],
+          cfg.loggerAddr[2], cfg.loggerAddr[3], cfg.loggerAddr[4], cfg.loggerAddr[5]);
+  ui.drawDialogText(BLUE, 2, "Successfully paired with the discovered logger.");
+  ui.drawDialogText(BLUE, 3, msgbuf2);
 
-  return false;
+  // update GUI
+  updateAppHint();
+  ui.drawTitleBar();
+
+  // save the app configuration
+  saveAppConfig();
+  return true;
 }
 
 /**
@@ -669,7 +842,9 @@ bool runClearFlash() {
   if (!connectLogger(1)) return false;
 
   ui.drawDialogText(BLUE, 2, "Erasing log data...");
-  if (logger.clearFlash(&onProgressUpdate)) {
+  loggerjob_t job;
+  memset((void*)loggerProgress, 0, sizeof(loggerProgress));
+  if (waitForLoggerJob(loggerTask.clearFlash(&onLoggerProgress), &job, true)) {
     ui.drawDialogText(BLACK, 2, "Erasing log data... done.");
   } else {
     ui.drawDialogText(RED, 2, "Erasing log data... timeout.");
@@ -680,7 +855,7 @@ bool runClearFlash() {
   // reload the logger and break
   ui.drawDialogText(BLUE, 3, "Reloading logger... ");
 
-  if (logger.reloadDevice()) {
+  if (waitForLoggerJob(loggerTask.reloadDevice(), &job, false)) {
     ui.drawDialogText(BLACK, 3, "Reloading logger... done.");
     ui.drawDialogText(BLUE, 4, "Hope you have a nice trip next time :)");
   } else {
@@ -695,7 +870,7 @@ bool runClearFlash() {
 
 void onClearFlashSelect(iconmenu_t* item) {
   bool result = runClearFlash();
-  logger.disconnect();
+  session.release();
 
   playBeep(result, BEEP_DURATION_LONG);
   ui.promptOk();
@@ -716,11 +891,13 @@ bool runSetLogFormat() {
   uint32_t newLogFormat = cfg.logFormat;
 
   ui.drawDialogText(BLUE, 1, "Updating the log format...");
-  if (!logger.getLogFormat(&curLogFormat)) {
+  loggerjob_t job;
+  if (!waitForLoggerJob(loggerTask.getLogFormat(), &job, false)) {
     ui.drawDialogText(RED, 1, "Updating the log format... failed");
     ui.drawDialogText(RED, 1, "Cannot get the current log format.");
     return false;
   }
+  curLogFormat = job.format;
 
   if (curLogFormat == newLogFormat) {
     char buf[40];
@@ -732,7 +909,7 @@ bool runSetLogFormat() {
     return true;
   }
 
-  if (!logger.setLogFormat(newLogFormat)) {
+  if (!waitForLoggerJob(loggerTask.setLogFormat(newLogFormat), &job, false)) {
     ui.drawDialogText(RED, 1, "Updating the log format... failed");
     ui.drawDialogText(RED, 2, "Failed to change the log format.");
     return false;
@@ -749,7 +926,7 @@ bool runSetLogFormat() {
 
 void onSetLogFormatSelect(iconmenu_t* item) {
   bool result = runSetLogFormat();
-  logger.disconnect();
+  session.release();
 
   playBeep(result, BEEP_DURATION_LONG);
   ui.promptOk();
@@ -780,7 +957,8 @@ bool runSetLogMode(logmodeset_t* lms) {
   }
 
   ui.drawDialogText(BLUE, 1, "Updating the log mode...");
-  if (!logger.setLogRecordMode(newRecMode) || !logger.setLogCriteria(newLogCri)) {
+  loggerjob_t job;
+  if (!waitForLoggerJob(loggerTask.setLogMode(newRecMode, newLogCri), &job, false)) {
     ui.drawDialogText(RED, 1, "Updating the log mode... failed.");
     ui.drawDialogText(RED, 2, "Cannot set the new log mode. Please retry.");
     return false;
@@ -796,7 +974,7 @@ bool runSetLogMode(logmodeset_t* lms) {
 
 void onSetLogModeSelect2(textmenu_t* item) {
   bool result = runSetLogMode((logmodeset_t*)(item->variable));
-  logger.disconnect();
+  session.release();
 
   playBeep(result, BEEP_DURATION_LONG);
   ui.promptOk();
@@ -878,6 +1056,43 @@ void putWayptGetValText(textmenu_t* item, char* buf, size_t len) {
   setBoolDescr(buf, cfg.putWaypt, len);
 }
 
+void compressGpxOnSelect(textmenu_t* item) {
+  cfg.compressGpx = (!cfg.compressGpx);
+}
+
+void compressGpxGetValText(textmenu_t* item, char* buf, size_t len) {
+  setBoolDescr(buf, cfg.compressGpx, len);
+}
+
+void splitFilesOnSelect(textmenu_t* item) {
+  cfg.splitFiles = (!cfg.splitFiles);
+}
+
+void splitFilesGetValText(textmenu_t* item, char* buf, size_t len) {
+  setBoolDescr(buf, cfg.splitFiles, len);
+}
+
+void saveStatsOnSelect(textmenu_t* item) {
+  cfg.saveStats = (!cfg.saveStats);
+}
+
+void saveStatsGetValText(textmenu_t* item, char* buf, size_t len) {
+  setBoolDescr(buf, cfg.saveStats, len);
+}
+
+void simplifyOnSelect(textmenu_t* item) {
+  uint8_t valCount = sizeof(SIMPLIFY_VALUES) / sizeof(float);
+  cfg.simplifyIdx = (cfg.simplifyIdx + 1) % valCount;
+}
+
+void simplifyGetValText(textmenu_t* item, char* buf, size_t len) {
+  if (SIMPLIFY_VALUES[cfg.simplifyIdx] == 0) {
+    strncpy(buf, "Disabled", len);
+  } else {
+    snprintf(buf, len, "%.0f meters", SIMPLIFY_VALUES[cfg.simplifyIdx]);
+  }
+}
+
 void logByDistOnSelect(textmenu_t* item) {
   uint8_t* cfgVar = (uint8_t*)item->variable;
   uint8_t valCount = sizeof(LOG_DIST_VALUES) / sizeof(int16_t);
@@ -1118,9 +1333,29 @@ void enableBeepGetValText(textmenu_t* item, char* buf, size_t len) {
   setBoolDescr(buf, cfg.playBeep, len);
 }
 
+void captureSessionOnSelect(textmenu_t* item) {
+  cfg.captureSession = (!cfg.captureSession);
+}
+
+void captureSessionGetValText(textmenu_t* item, char* buf, size_t len) {
+  setBoolDescr(buf, cfg.captureSession, len);
+}
+
+void latestOnlyOnSelect(textmenu_t* item) {
+  cfg.latestOnly = (!cfg.latestOnly);
+}
+
+void latestOnlyGetValText(textmenu_t* item, char* buf, size_t len) {
+  setBoolDescr(buf, cfg.latestOnly, len);
+}
+
 void clearCacheFileOnSelect(textmenu_t* item) {
   if (SDcard.exists(TEMP_BIN_NAME)) SDcard.remove(TEMP_BIN_NAME);
   if (SDcard.exists(TEMP_GPX_NAME)) SDcard.remove(TEMP_GPX_NAME);
+  if (SDcard.exists(TEMP_JSON_NAME)) SDcard.remove(TEMP_JSON_NAME);
+  if (SDcard.exists(TEMP_IDX_NAME)) SDcard.remove(TEMP_IDX_NAME);
+  if (SDcard.exists(CAPTURE_NAME)) SDcard.remove(CAPTURE_NAME);
+  if (SDcard.exists(TEMP_LATEST_NAME)) SDcard.remove(TEMP_LATEST_NAME);
 
   ui.drawDialogFrame("Delete cache file");
   ui.drawNavBar(NULL);
@@ -1281,8 +1516,9 @@ void setup() {
   SDcard.begin(GPIO_NUM_4, SD_ACCESS_SPEED);
   sb.init();
 
-  // set the bluetooth event handler
+  // set the bluetooth event handler and start the task to run the long logger jobs
   logger.setEventCallback(onBTStatusUpdate);
+  loggerTask.begin();
 
   // load the configuration data
   M5.update();
@@ -1297,6 +1533,7 @@ void setup() {
   ui.setSDcardStatus((bool)SDcard.card()->sectorCount());
   ui.drawTitleBar();
   ui.setIdleCallback(&onAppInputIdle, IDLE_TIMEOUT);
+  ui.setPollCallback(&onAppPoll);
 
   // if left button is pressed, clear the configuration
   if (cfg.firstRun) {
@@ -0,0 +1,387 @@
+# mtk-logger-sim.py
+# This is a script emulating a MTK GPS logger (747PRO, M-241 and so on) on a
+# Linux pseudo terminal. It answers the PMTK commands used by MtkLogger class
+# from a log data image (.bin), so the download can be benchmarked and the
+# pipelining and retry logic can be tested without a physical logger.
+#
+# Supported commands:
+#   PMTK182,7,ADDR,SIZE  read the log data (replied by PMTK182,8 in 0x800 blocks)
+#   PMTK182,2,n          get a log setting (replied by PMTK182,3,n,value)
+#   PMTK182,1,n,value    set a log setting
+#   PMTK182,6,1          erase the log data
+#   PMTK605              get the firmware release (replied by PMTK705)
+#   PMTK335, PMTK101, PMTK000
+#
+# The link can be impaired with the latency, the bandwidth, and the rate of
+# lost / reordered / truncated replies. The statistics are printed on exit.
+# The same emulator is built into tools/replay-host/sim.cpp, which runs the
+# download of the MtkLogger code against it in one process and compares the
+# result with the image (make -C tools/replay-host check IMAGE=download.bin).
+#
+# A session captured by SmallStep ("Capture session" in the app settings) can
+# be replayed instead of emulating a logger. The received data following each
+# captured command is sent when the next command arrives, at the original
+# timing or at the maximum speed:
+# $ python3 mtk-logger-sim.py --replay capture.bin --speed orig
+# $ python3 mtk-logger-sim.py --replay capture.bin --dump
+# The replies are sent in the captured order, so a download retrying or
+# pipelining differently gets the wrong replies. Use tools/replay-host to
+# replay a capture through the MtkLogger code with the replies matched by
+# the address of each read request.
+#
+# To run on Ubuntu (Python 3 only; no extra package is required):
+# $ python3 mtk-logger-sim.py --image download.bin --latency 150 --bandwidth 20000 --loss 0.01
+# then open the printed pty device (or the path given by --link) at any baud rate.
+
+import argparse
+import os
+import pty
+import random
+import select
+import struct
+import sys
+import termios
+import time
+import tty
+
+SIZE_REPLY = 0x800
+SIZE_SECTOR = 0x10000
+FLASH_SIZES = {"8": 0x100000, "16": 0x200000, "32": 0x400000}
+MODEL_IDS = {"8": "1388", "16": "001B", "32": "0004"}
+CAPTURE_MAGIC = b"SSCAPTR1"
+CAPTURE_RX = 0
+CAPTURE_TX = 1
+
+
+def checksum(body):
+    cs = 0
+    for ch in body.encode("ascii"):
+        cs ^= ch
+    return cs
+
+
+def sentence(body):
+    return ("$%s*%02X\r\n" % (body, checksum(body))).encode("ascii")
+
+
+class Link:
+    """Paces the replies by the latency and the bandwidth, and impairs them."""
+
+    def __init__(self, args, rng):
+        self.args = args
+        self.rng = rng
+        self.queue = []  # [ready time, bytes]
+        self.ready = 0.0
+        self.stats = {"sent": 0, "replies": 0, "lost": 0, "reordered": 0, "truncated": 0}
+
+    def put(self, replies, data=False):
+        # the first reply of a command comes after the latency
+        at = max(time.monotonic() + (self.args.latency / 1000.0), self.ready)
+
+        replies = list(replies)
+        if data:
+            for i in range(len(replies) - 1):
+                if self.rng.random() < self.args.reorder:
+                    replies[i], replies[i + 1] = replies[i + 1], replies[i]
+                    self.stats["reordered"] += 1
+
+        for reply in replies:
+            if data and reply.startswith(b"$PMTK182,8,"):
+                if self.rng.random() < self.args.loss:
+                    self.stats["lost"] += 1
+                    continue
+                if self.rng.random() < self.args.truncate:
+                    reply = reply[: self.rng.randrange(12, len(reply) - 4)]
+                    self.stats["truncated"] += 1
+
+            self.queue.append([at, reply])
+            self.stats["replies"] += 1
+
+    def pending(self):
+        return len(self.queue) > 0
+
+    def next_time(self):
+        return self.queue[0][0] if self.queue else None
+
+    def write(self, fd):
+        now = time.monotonic()
+        if (not self.queue) or (self.queue[0][0] > now):
+            return
+
+        at, reply = self.queue[0]
+        chunk = reply[:256]
+        os.write(fd, chunk)
+        self.stats["sent"] += len(chunk)
+
+        # keep the rest of the reply until the bandwidth allows
+        delay = (len(chunk) / self.args.bandwidth) if (self.args.bandwidth > 0) else 0.0
+        self.ready = now + delay
+        if len(chunk) < len(reply):
+            self.queue[0] = [self.ready, reply[len(chunk):]]
+        else:
+            self.queue.pop(0)
+            if self.queue:
+                self.queue[0][0] = max(self.queue[0][0], self.ready)
+
+
+class Logger:
+    """Emulates the PMTK command set of a MTK logger."""
+
+    def __init__(self, args, link):
+        self.args = args
+        self.link = link
+        self.flash_size = FLASH_SIZES[args.flash]
+        self.model_id = args.model if (args.model is not None) else MODEL_IDS[args.flash]
+        self.flash = bytearray(b"\xff" * self.flash_size)
+        if args.image:
+            with open(args.image, "rb") as f:
+                image = f.read(self.flash_size)
+            self.flash[: len(image)] = image
+            self.data_size = len(image)
+        else:
+            self.data_size = 0
+        # settings: 2 = format, 3 = time, 4 = distance, 5 = speed, 6 = record mode
+        self.settings = {2: 0x0002003F, 3: 50, 4: 0, 5: 0, 6: args.record_mode}
+
+    def ack(self, cmd, flag=3):
+        return sentence("PMTK001,%s,%d" % (cmd, flag))
+
+    def handle(self, body):
+        fields = body.split(",")
+        cmd = fields[0]
+
+        if cmd == "PMTK182" and len(fields) >= 2:
+            self.handle_log(fields)
+        elif cmd == "PMTK605":
+            release = "PMTK705,AXN_1.0-B_1.3_C01,%s,SIMULATOR,1.0" % self.model_id
+            self.link.put([sentence(release), self.ack("605")])
+        elif cmd == "PMTK335":
+            self.link.put([self.ack("335")])
+        elif cmd == "PMTK101":
+            self.link.put([sentence("PMTK010,001")])
+        elif cmd == "PMTK000":
+            self.link.put([self.ack("0")])
+        else:
+            self.link.put([self.ack(cmd[4:], 1)])
+
+    def handle_log(self, fields):
+        sub = fields[1]
+
+        if sub == "7" and len(fields) >= 4:  # read the log data
+            addr = int(fields[2], 16)
+            size = int(fields[3], 16)
+            replies = []
+            for pos in range(addr, addr + size, SIZE_REPLY):
+                block = self.flash[pos : min(pos + SIZE_REPLY, addr + size)]
+                replies.append(sentence("PMTK182,8,%08X,%s" % (pos, block.hex().upper())))
+            replies.append(self.ack("182,7"))
+            self.link.put(replies, data=True)
+        elif sub == "2" and len(fields) >= 3:  # get a setting
+            n = int(fields[2])
+            if n == 8:
+                value = "%08X" % self.last_address()
+            elif n == 2:
+                value = "%08X" % self.settings[2]
+            elif n in self.settings:
+                value = "%d" % self.settings[n]
+            else:
+                self.link.put([self.ack("182,2", 1)])
+                return
+            self.link.put([sentence("PMTK182,3,%d,%s" % (n, value)), self.ack("182,2")])
+        elif sub == "1" and len(fields) >= 4:  # set a setting
+            n = int(fields[2])
+            self.settings[n] = int(fields[3], 16) if (n == 2) else int(fields[3])
+            self.link.put([self.ack("182,1")])
+        elif sub == "6" and len(fields) >= 3:  # erase
+            time.sleep(self.args.erase_time / 1000.0)
+            self.flash = bytearray(b"\xff" * self.flash_size)
+            self.data_size = 0
+            self.link.put([self.ack("182,6")])
+        else:
+            self.link.put([self.ack("182", 1)])
+
+    def last_address(self):
+        # the address next to the last record (the log data ends with 0xFF)
+        end = self.data_size
+        while (end > 0) and (self.flash[end - 1] == 0xFF):
+            end -= 1
+        return end
+
+
+def read_capture(path):
+    """Reads a capture file into a list of (time, dir, data)."""
+    records = []
+    with open(path, "rb") as f:
+        if f.read(len(CAPTURE_MAGIC)) != CAPTURE_MAGIC:
+            raise ValueError("%s is not a capture file" % path)
+        while True:
+            header = f.read(8)
+            if len(header) < 8:
+                break
+            at, length, direction, _ = struct.unpack("<IHBB", header)
+            records.append((at, direction, f.read(length)))
+    return records
+
+
+def dump_capture(records):
+    for at, direction, data in records:
+        if direction == CAPTURE_TX:
+            print("%8d TX %s" % (at, data.decode("ascii", "replace")))
+        else:
+            print("%8d RX %d bytes: %s" % (at, len(data), data[:48].decode("ascii", "replace").replace("\r\n", " ")))
+
+
+def replay_capture(args, records, master):
+    """Sends the received data of each captured command when the client sends the next command."""
+    # split the records into the segments starting with a command (the data before the first command is sent at once)
+    segments = [[None, []]]
+    for at, direction, data in records:
+        if direction == CAPTURE_TX:
+            segments.append([at, []])
+        else:
+            segments[-1][1].append((at, data))
+
+    sent = 0
+    commands = 0
+    rxbuf = b""
+    queue = []  # [send time, data]
+    started = time.monotonic()
+
+    def schedule(segment):
+        base_at, rx = segment
+        base = time.monotonic()
+        for at, data in rx:
+            delay = ((at - (base_at if base_at is not None else rx[0][0])) / 1000.0) if (args.speed == "orig") else 0
+            queue.append([base + delay, data])
+
+    schedule(segments[0])
+    next_segment = 1
+    try:
+        while (next_segment < len(segments)) or queue:
+            timeout = 0.05
+            if queue:
+                timeout = max(0.0, min(timeout, queue[0][0] - time.monotonic()))
+            readable, _, _ = select.select([master], [], [], timeout)
+
+            if master in readable:
+                rxbuf += os.read(master, 1024)
+                while b"\n" in rxbuf:
+                    line, rxbuf = rxbuf.split(b"\n", 1)
+                    if not line.strip().startswith(b"$"):
+                        continue
+                    commands += 1
+                    if next_segment < len(segments):
+                        schedule(segments[next_segment])
+                        next_segment += 1
+
+            while queue and (queue[0][0] <= time.monotonic()):
+                data = queue.pop(0)[1]
+                os.write(master, data)
+                sent += len(data)
+    except KeyboardInterrupt:
+        pass
+
+    elapsed = time.monotonic() - started
+    print(
+        "mtk-logger-sim: replayed %d bytes for %d commands in %.1f sec (%d of %d segments)"
+        % (sent, commands, elapsed, next_segment, len(segments)),
+        file=sys.stderr,
+    )
+
+
+def main():
+    parser = argparse.ArgumentParser(description="MTK GPS logger simulator on a pseudo terminal")
+    parser.add_argument("--image", help="log data image (.bin) to download")
+    parser.add_argument("--flash", choices=["8", "16", "32"], default="32", help="flash size in Mbit")
+    parser.add_argument("--model", help="firmware ID in hex (default: a model with the flash size)")
+    parser.add_argument("--record-mode", type=int, default=1, help="1: overwrite, 2: stop when full")
+    parser.add_argument("--latency", type=float, default=100, help="latency of the first reply (msec)")
+    parser.add_argument("--bandwidth", type=float, default=20000, help="bytes per second (0: unlimited)")
+    parser.add_argument("--loss", type=float, default=0.0, help="rate of the lost data replies")
+    parser.add_argument("--reorder", type=float, default=0.0, help="rate of the swapped data replies")
+    parser.add_argument("--truncate", type=float, default=0.0, help="rate of the truncated data replies")
+    parser.add_argument("--nmea-interval", type=float, default=1000, help="interval of GGA/RMC (msec; 0: off)")
+    parser.add_argument("--erase-time", type=float, default=2000, help="time to erase the flash (msec)")
+    parser.add_argument("--seed", type=int, help="random seed for the impairments")
+    parser.add_argument("--link", help="create a symlink to the pty device at this path")
+    parser.add_argument("--replay", help="replay a capture file instead of emulating a logger")
+    parser.add_argument("--speed", choices=["orig", "max"], default="orig", help="replay speed")
+    parser.add_argument("--dump", action="store_true", help="print the capture file given by --replay and exit")
+    args = parser.parse_args()
+
+    records = None
+    if args.replay:
+        records = read_capture(args.replay)
+        if args.dump:
+            dump_capture(records)
+            return
+
+    rng = random.Random(args.seed)
+    link = Link(args, rng)
+    logger = Logger(args, link)
+
+    master, slave = pty.openpty()
+    tty.setraw(slave, termios.TCSANOW)
+    slave_name = os.ttyname(slave)
+    if args.link:
+        if os.path.islink(args.link):
+            os.unlink(args.link)
+        os.symlink(slave_name, args.link)
+    print("mtk-logger-sim: listening on %s" % (args.link or slave_name), file=sys.stderr)
+
+    if records is not None:
+        replay_capture(args, records, master)
+        if args.link and os.path.islink(args.link):
+            os.unlink(args.link)
+        return
+
+    rxbuf = b""
+    next_nmea = time.monotonic()
+    started = time.monotonic()
+    try:
+        while True:
+            now = time.monotonic()
+
+            # emit the periodic NMEA sentences (the logger sends them while logging)
+            if (args.nmea_interval > 0) and (now >= next_nmea):
+                link.queue.append([now, sentence("GPGGA,000000.000,0000.0000,N,00000.0000,E,0,0,,,M,,M,,")])
+                link.queue.append([now, sentence("GPRMC,000000.000,V,0000.0000,N,00000.0000,E,0.00,0.00,010120,,,N")])
+                next_nmea = now + (args.nmea_interval / 1000.0)
+
+            timeout = 0.05
+            if link.pending():
+                timeout = max(0.0, min(timeout, link.next_time() - now))
+            readable, writable, _ = select.select([master], [master] if link.pending() else [], [], timeout)
+
+            if master in readable:
+                rxbuf += os.read(master, 1024)
+                while b"\n" in rxbuf:
+                    line, rxbuf = rxbuf.split(b"\n", 1)
+                    line = line.strip().decode("ascii", "replace")
+                    if (not line.startswith("$")) or ("*" not in line):
+                        continue
+                    body, cs = line[1:].rsplit("*", 1)
+                    if cs.upper() != ("%02X" % checksum(body)):
+                        print("mtk-logger-sim: bad checksum: %s" % line, file=sys.stderr)
+                        continue
+                    logger.handle(body)
+
+            if master in writable:
+                link.write(master)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        elapsed = time.monotonic() - started
+        stats = link.stats
+        print(
+            "mtk-logger-sim: %d bytes in %.1f sec (%.0f B/s), replies=%d, lost=%d, reordered=%d, truncated=%d"
+            % (stats["sent"], elapsed, stats["sent"] / max(elapsed, 0.001), stats["replies"], stats["lost"],
+               stats["reordered"], stats["truncated"]),
+            file=sys.stderr,
+        )
+        if args.link and os.path.islink(args.link):
+            os.unlink(args.link)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,132 @@
+// host.cpp
+// This is the runtime shared by the host harnesses. The time is virtual: it advances only while MtkLogger waits for
+// the data in ulTaskNotifyTake() or calls delay(), so a harness runs at full speed. In the real time mode, the
+// virtual time is kept in step with the wall clock, so a session takes the time it would take on the device.
+
+#include "host.h"
+
+#include <chrono>
+#include <queue>
+#include <thread>
+
+typedef struct _event {
+  uint32_t at;  // virtual time to deliver
+  uint32_t seq;
+  std::string data;
+  bool operator<(const struct _event &e) const { return (at != e.at) ? (at > e.at) : (seq > e.seq); }
+} event_t;
+
+HardwareSerial Serial;
+BluetoothSerialDataCb BluetoothSerial::dataCallback;
+
+static uint32_t now = 0;         // virtual time (msec)
+static uint32_t eventSeq = 0;    // sequence number to keep the order of the replies at the same time
+static bool notified = false;    // the pending task notification
+static uint32_t emptyPolls = 0;  // the polls with no timeout that found nothing
+static bool realTime = false;    // keep the virtual time in step with the wall clock
+static std::chrono::steady_clock::time_point startedAt;
+static std::priority_queue<event_t> events;
+
+/**
+ * @fn void hostStart(bool rt)
+ * @brief Start the virtual clock.
+ * @param rt Set true to keep the virtual time in step with the wall clock.
+ */
+void hostStart(bool rt) {
+  realTime = rt;
+  startedAt = std::chrono::steady_clock::now();
+}
+
+/**
+ * @fn void hostDeliver(uint32_t at, const std::string &data)
+ * @brief Schedule the characters to be received by MtkLogger at the given virtual time.
+ */
+void hostDeliver(uint32_t at, const std::string &data) {
+  events.push({at, eventSeq++, data});
+}
+
+/**
+ * @fn std::string hostSentence(const char *body)
+ * @brief Make a NMEA sentence with the checksum and CR/LF from the body ("PMTK001,0,3" and so on).
+ */
+std::string hostSentence(const char *body) {
+  uint8_t cs = 0;
+  for (const char *p = body; *p != '\0'; p++) cs ^= *p;
+
+  char tail[8];
+  sprintf(tail, "*%02X\r\n", cs);
+  return std::string("$") + body + tail;
+}
+
+/* Arduino / FreeRTOS shim */
+
+int HardwareSerial::printf(const char *fmt, ...) {
+  if (quiet) return 0;
+
+  va_list ap;
+  va_start(ap, fmt);
+  int len = ::fprintf(stdout, "%8u ", now);
+  len += ::vfprintf(stdout, fmt, ap);
+  va_end(ap);
+  return len;
+}
+
+void HardwareSerial::println(const char *str) {
+  if (!quiet) ::fprintf(stdout, "%8u %s\n", now, str);
+}
+
+/**
+ * @fn void advanceTo(uint32_t at)
+ * @brief Advance the virtual time. In the real time mode, sleep until the wall clock reaches the time.
+ */
+static void advanceTo(uint32_t at) {
+  if (at <= now) return;
+
+  if (realTime) std::this_thread::sleep_until(startedAt + std::chrono::milliseconds(at));
+  now = at;
+}
+
+uint32_t millis() {
+  return now;
+}
+
+void delay(uint32_t ms) {
+  advanceTo(now + ms);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return (TaskHandle_t)&notified;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  notified = true;
+  return pdPASS;
+}
+
+/**
+ * @fn uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+ * @brief Advance the virtual time and deliver the scheduled replies until the task is notified or the timeout.
+ */
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+  uint32_t deadline = (ticks > (0xFFFFFFFF - now)) ? 0xFFFFFFFF : (now + ticks);
+
+  while ((!notified) && (!events.empty()) && (events.top().at <= deadline)) {
+    event_t ev = events.top();
+    events.pop();
+
+    advanceTo(ev.at);
+    BluetoothSerial::dataCallback((const uint8_t *)ev.data.data(), ev.data.size());
+  }
+
+  if (notified) {
+    notified = false;
+    emptyPolls = 0;
+    return 1;
+  }
+
+  // a busy loop polling with no timeout would never see the time elapse. let every other empty poll cost a tick
+  if ((ticks == 0) && ((++emptyPolls % 2) == 0)) deadline++;
+
+  advanceTo(deadline);
+  return 0;
+}
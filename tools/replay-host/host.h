@@ -0,0 +1,14 @@
+#pragma once
+
+// Runtime shared by the host harnesses (replay.cpp, sim.cpp): the virtual clock, the FreeRTOS task notification, and
+// the delivery of the scheduled replies to MtkLogger through the callback of the BluetoothSerial shim.
+// Each harness implements hostCommand() to answer the commands sent by MtkLogger.
+
+#include <string>
+
+#include "MtkLogger.h"
+
+void hostStart(bool realTime);
+void hostDeliver(uint32_t at, const std::string &data);
+std::string hostSentence(const char *body);
+void hostCommand(const char *line);
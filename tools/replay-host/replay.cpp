@@ -0,0 +1,196 @@
+// replay.cpp
+// This is a host harness replaying a session captured by SmallStep ("Capture session" in the app settings) through
+// the real MtkLogger::downloadLogData(), NmeaBuffer and MtkDataDecoder code. The download can be reproduced and
+// profiled on a PC with the replies and the timing of the field, without a logger.
+//
+// The replies are not replayed in the captured order. They are looked up by the content of each command sent by
+// MtkLogger, so a different retry or pipelining pattern still gets the right replies:
+//   PMTK182,7,ADDR,SIZE  each 0x800 block in the range is answered by the captured PMTK182,8 reply of the same
+//                        address (the blocks never received in the capture are lost), then by the ACK
+//   other commands       answered by the replies captured after the same command
+// Each reply is delivered after the delay measured in the capture from its command or from the previous reply,
+// whichever is later (the time the logger took to make the reply), counted from the command or the previous replayed
+// reply in the same way, since the link is a serial stream. The time is virtual, so the replay runs at full speed by
+// default. With -r, the virtual time is kept in step with the wall clock, so the replay takes the original time (to
+// watch or profile the download as it happened); the timestamps and the statistics are the same in both modes.
+//
+// To build and run on Ubuntu (g++ only; no extra package is required):
+// $ make -C tools/replay-host
+// $ tools/replay-host/replay capture.bin download.bin [-q] [-r]
+// then compare download.bin with the cache file of the field, or convert it with the app.
+//   -q  do not print the log of MtkLogger
+//   -r  replay at the original speed (real time)
+
+#include <map>
+#include <vector>
+
+#include "host.h"
+
+#define SIZE_REPLY_BLOCK 0x800
+
+typedef struct _reply {
+  uint32_t delay;    // delay from the command or the previous reply to the reply in the capture (msec)
+  std::string line;  // the reply with CR/LF
+} reply_t;
+
+MtkLogger logger("replay");  // static like the app's instance (the members not set by the constructor are zeroed)
+
+static uint32_t lastAt = 0;  // virtual time of the last scheduled reply
+static std::map<int32_t, reply_t> blockReplies;                  // PMTK182,8 replies by address
+static std::map<std::string, std::vector<reply_t> > cmdReplies;  // other replies by command
+static uint32_t blocksSent = 0;
+static uint32_t blocksLost = 0;
+static uint32_t unknownCommands = 0;
+
+static void schedule(uint32_t delay, const std::string &data) {
+  uint32_t at = ((millis() > lastAt) ? millis() : lastAt) + delay;
+
+  hostDeliver(at, data);
+  lastAt = at;
+}
+
+/**
+ * @fn void hostCommand(const char *line)
+ * @brief Called by the BluetoothSerial shim for each command sent by MtkLogger. Schedule the captured replies.
+ */
+void hostCommand(const char *line) {
+  std::string body(line + ((line[0] == '$') ? 1 : 0));
+  body = body.substr(0, body.find('*'));
+
+  int32_t addr, size;
+  if (sscanf(body.c_str(), "PMTK182,7,%x,%x", &addr, &size) == 2) {
+    for (int32_t pos = addr; pos < (addr + size); pos += SIZE_REPLY_BLOCK) {
+      std::map<int32_t, reply_t>::iterator it = blockReplies.find(pos);
+      if (it == blockReplies.end()) {
+        blocksLost++;
+        continue;
+      }
+
+      schedule(it->second.delay, it->second.line);
+      blocksSent++;
+    }
+
+    schedule(0, hostSentence("PMTK001,182,7,3"));
+    return;
+  }
+
+  std::map<std::string, std::vector<reply_t> >::iterator it = cmdReplies.find(body);
+  if (it == cmdReplies.end()) {
+    Serial.printf("Replay: no captured reply for %s\n", body.c_str());
+    unknownCommands++;
+    return;
+  }
+  for (size_t i = 0; i < it->second.size(); i++) schedule(it->second[i].delay, it->second[i].line);
+}
+
+/**
+ * @fn bool loadCapture(const char *path)
+ * @brief Read the capture file and index the replies by the address of the data block or by the command.
+ */
+static bool loadCapture(const char *path) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) return false;
+
+  char magic[8];
+  if ((fread(magic, 1, sizeof(magic), fp) != sizeof(magic)) || (memcmp(magic, "SSCAPTR1", sizeof(magic)) != 0)) {
+    fclose(fp);
+    return false;
+  }
+
+  std::vector<std::pair<uint32_t, std::string> > commands;  // (time, command) of the sent commands
+  std::map<std::string, size_t> firstCommands;              // the index of the first time of each command
+  std::string rxLine;
+  uint32_t lastReplyAt = 0;  // the time of the previous reply
+  capturerecord_t rcd;
+
+  while (fread(&rcd, 1, sizeof(rcd), fp) == sizeof(rcd)) {
+    std::string data(rcd.length, '\0');
+    if (fread(&data[0], 1, rcd.length, fp) != rcd.length) break;
+
+    if (rcd.dir == CAPTURE_TX) {
+      std::string body = data.substr(((data[0] == '$') ? 1 : 0));
+      body = body.substr(0, body.find('*'));
+      if (firstCommands.find(body) == firstCommands.end()) firstCommands[body] = commands.size();
+      commands.push_back(std::make_pair(rcd.time, body));
+      continue;
+    }
+
+    // split the received characters into the lines (a line may be split into the records)
+    for (size_t i = 0; i < data.size(); i++) {
+      rxLine += data[i];
+      if (data[i] != '\n') continue;
+
+      std::string line = rxLine;
+      rxLine.clear();
+      if ((line.compare(0, 5, "$PMTK") != 0) || (commands.empty())) continue;
+
+      // the delay is measured from the later of the last command and the previous reply
+      uint32_t delay = rcd.time - ((commands.back().first > lastReplyAt) ? commands.back().first : lastReplyAt);
+      lastReplyAt = rcd.time;
+
+      int32_t addr;
+      if (sscanf(line.c_str(), "$PMTK182,8,%x,", &addr) == 1) {
+        // keep the first reply of each block to a read request covering it
+        for (size_t j = commands.size(); j > 0; j--) {
+          int32_t reqAddr, reqSize;
+          if ((sscanf(commands[j - 1].second.c_str(), "PMTK182,7,%x,%x", &reqAddr, &reqSize) == 2) &&
+              (addr >= reqAddr) && (addr < (reqAddr + reqSize))) {
+            if (blockReplies.find(addr) == blockReplies.end()) {
+              blockReplies[addr] = {delay, line};
+            }
+            break;
+          }
+        }
+      } else if (commands.back().second.compare(0, 10, "PMTK182,7,") != 0) {
+        // keep the replies of the first time of each command (the ACKs of the read requests are made up)
+        if (firstCommands[commands.back().second] == (commands.size() - 1)) {
+          cmdReplies[commands.back().second].push_back({delay, line});
+        }
+      }
+    }
+  }
+  fclose(fp);
+
+  Serial.printf("Replay: %d commands, %d data blocks and %d other commands captured\n", (int)commands.size(),
+                (int)blockReplies.size(), (int)cmdReplies.size());
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s capture.bin output.bin [-q] [-r]\n", argv[0]);
+    return 2;
+  }
+
+  bool realTime = false;
+  for (int i = 3; i < argc; i++) {
+    if (strcmp(argv[i], "-q") == 0) Serial.quiet = true;
+    if (strcmp(argv[i], "-r") == 0) realTime = true;
+  }
+  hostStart(realTime);
+
+  if (!loadCapture(argv[1])) {
+    fprintf(stderr, "replay: %s is not a capture file\n", argv[1]);
+    return 1;
+  }
+
+  File32 output;
+  if (!output.open(argv[2], "w+b")) {
+    fprintf(stderr, "replay: cannot open %s\n", argv[2]);
+    return 1;
+  }
+
+  uint8_t addr[6] = {0, 0, 0, 0, 0, 0};
+  logger.connect(addr);
+  bool result = logger.downloadLogData(&output, NULL, NULL);
+  output.close();
+
+  dlstats_t st = logger.getDownloadStats();
+  fprintf(stderr,
+          "replay: %s [bytes=%u, time=%u, rate=%u, reqs=%u, timeouts=%u, resent=%u, blocks=%u sent/%u lost, "
+          "unknown=%u]\n",
+          (result) ? "done" : "failed", st.bytes, st.elapsed, st.rateAvg, st.requests, st.timeouts, st.resent,
+          blocksSent, blocksLost, unknownCommands);
+
+  return (result) ? 0 : 1;
+}
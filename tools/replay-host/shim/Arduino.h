@@ -0,0 +1,70 @@
+#pragma once
+
+// Minimal Arduino / FreeRTOS API for building the logger classes on the host (see ../host.cpp).
+// The time is virtual: it advances only while the logger waits for the data in ulTaskNotifyTake().
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <functional>
+#include <string>
+
+typedef uint8_t byte;
+
+class String {
+ private:
+  char buf[64];
+
+ public:
+  String() { buf[0] = '\0'; }
+  String(const char *s) {
+    strncpy(buf, (s == NULL) ? "" : s, (sizeof(buf) - 1));
+    buf[sizeof(buf) - 1] = '\0';
+  }
+  const char *c_str() const { return buf; }
+  size_t length() const { return strlen(buf); }
+};
+
+class HardwareSerial {
+ public:
+  bool quiet = false;
+  int printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+  void println(const char *str);
+  void begin(int speed) {}
+};
+extern HardwareSerial Serial;
+
+uint32_t millis();  // unsigned long is 32 bits on the ESP32
+void delay(uint32_t ms);
+
+template <class T>
+T max(T a, T b) {
+  return (a > b) ? a : b;
+}
+template <class T>
+T min(T a, T b) {
+  return (a < b) ? a : b;
+}
+
+// FreeRTOS (only the task notification used by MtkLogger::receive())
+typedef void *TaskHandle_t;
+typedef void *QueueHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFF
+#define pdMS_TO_TICKS(x) (x)
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
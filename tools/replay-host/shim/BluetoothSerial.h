@@ -0,0 +1,88 @@
+#pragma once
+
+// Host version of BluetoothSerial: the characters written by MtkLogger are passed to hostCommand() line by line,
+// and the replies are delivered by the virtual clock (../host.cpp) through the callback set by onData().
+
+#include <Arduino.h>
+
+typedef enum {
+  ESP_SPP_INIT_EVT,
+  ESP_SPP_UNINIT_EVT,
+  ESP_SPP_OPEN_EVT,
+  ESP_SPP_CLOSE_EVT,
+  ESP_SPP_DATA_IND_EVT
+} esp_spp_cb_event_t;
+
+typedef uint8_t esp_bd_addr_t[6];
+typedef union {
+  struct {
+    esp_bd_addr_t rem_bda;
+  } open;
+} esp_spp_cb_param_t;
+typedef void (*esp_spp_cb_t)(esp_spp_cb_event_t, esp_spp_cb_param_t *);
+
+class BTAddress {
+ private:
+  uint8_t addr[6];
+
+ public:
+  const uint8_t *getNative() const { return addr; }
+  std::string toString() const { return "00:00:00:00:00:00"; }
+};
+
+class BTAdvertisedDevice {
+ public:
+  virtual ~BTAdvertisedDevice() {}
+  virtual BTAddress getAddress() = 0;
+  virtual std::string getName() = 0;
+  virtual bool haveName() = 0;
+};
+
+class BTScanResults {
+ public:
+  virtual ~BTScanResults() {}
+  virtual int getCount() = 0;
+  virtual BTAdvertisedDevice *getDevice(int i) = 0;
+};
+
+typedef std::function<void(const uint8_t *, size_t)> BluetoothSerialDataCb;
+
+void hostCommand(const char *line);
+
+class BluetoothSerial {
+ private:
+  char line[256];
+  size_t lineLen = 0;
+  bool conn = false;
+
+ public:
+  static BluetoothSerialDataCb dataCallback;
+
+  bool begin(const char *name, bool master) { return true; }
+  void end() {}
+  bool connect(String name) { return (conn = true); }
+  bool connect(uint8_t *addr) { return (conn = true); }
+  bool connected(int timeout = 0) { return conn; }
+  bool disconnect() {
+    conn = false;
+    return true;
+  }
+  void flush() {}
+  void setTimeout(int timeout) {}
+  bool setPin(const char *pin) { return true; }
+  int register_callback(esp_spp_cb_t callback) { return 0; }
+  void onData(BluetoothSerialDataCb callback) { dataCallback = callback; }
+  BTScanResults *discover(int timeout) { return NULL; }
+  void discoverClear() {}
+
+  size_t write(uint8_t c) {
+    if (c == '\n') {
+      line[lineLen] = '\0';
+      hostCommand(line);
+      lineLen = 0;
+    } else if ((c != '\r') && (lineLen < (sizeof(line) - 1))) {
+      line[lineLen++] = c;
+    }
+    return 1;
+  }
+};
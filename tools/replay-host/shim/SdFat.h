@@ -0,0 +1,48 @@
+#pragma once
+
+// Host version of File32 backed by a stdio file (only the methods used by MtkLogger are implemented).
+
+#include <Arduino.h>
+#include <unistd.h>
+
+#define O_RDONLY 0
+#define O_WRONLY 1
+#define O_RDWR 2
+#define O_CREAT 0x40
+#define O_TRUNC 0x200
+
+class File32 {
+ private:
+  FILE *fp = NULL;
+
+ public:
+  bool open(const char *path, const char *mode) { return ((fp = fopen(path, mode)) != NULL); }
+  bool close() {
+    if (fp != NULL) fclose(fp);
+    fp = NULL;
+    return true;
+  }
+  operator bool() { return (fp != NULL); }
+
+  size_t write(const void *data, size_t len) { return fwrite(data, 1, len, fp); }
+  size_t write(uint8_t c) { return write(&c, 1); }
+  int read(void *data, size_t len) { return fread(data, 1, len, fp); }
+  void flush() { fflush(fp); }
+  bool seek(uint32_t pos) { return ((pos <= fileSize()) && (fseek(fp, pos, SEEK_SET) == 0)); }
+  bool seekCur(int32_t mv) { return (fseek(fp, mv, SEEK_CUR) == 0); }
+  uint32_t curPosition() { return ftell(fp); }
+  uint32_t position() { return ftell(fp); }
+  uint32_t fileSize() {
+    long pos = ftell(fp);
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, pos, SEEK_SET);
+    return size;
+  }
+  uint32_t size() { return fileSize(); }
+  bool truncate(uint32_t len) {
+    fflush(fp);
+    return (ftruncate(fileno(fp), len) == 0);
+  }
+  bool preAllocate(uint64_t len) { return false; }
+};
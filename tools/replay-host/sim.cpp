@@ -0,0 +1,341 @@
+// sim.cpp
+// This is a host harness running the real MtkLogger::downloadLogData() against an emulated MTK logger serving a log
+// data image (.bin), then comparing the downloaded file with the image. The link can be impaired in the same way as
+// tools/mtk-logger-sim.py (latency, bandwidth, and the rate of lost / reordered / truncated data replies), so the
+// pipelining of downloadRange(), the retry of requestMissingBlocks() and the adaptation of adaptLink() can be tested
+// on a PC without a logger. The emulator runs in the same process on the virtual clock of host.cpp.
+//
+// Supported commands:
+//   PMTK182,7,ADDR,SIZE  read the log data (replied by PMTK182,8 in 0x800 blocks, then by the ACK)
+//   PMTK182,2,n          get a log setting (replied by PMTK182,3,n,value)
+//   PMTK182,1,n,value    set a log setting
+//   PMTK182,6,1          erase the log data
+//   PMTK605              get the firmware release (replied by PMTK705)
+//   PMTK335, PMTK101, PMTK000
+//
+// To build and run on Ubuntu (g++ only; no extra package is required):
+// $ make -C tools/replay-host sim
+// $ tools/replay-host/sim download.bin output.bin -p 0.02 -o 0.05 -t 0.01
+// $ make -C tools/replay-host check IMAGE=download.bin  (runs the download with several impairments)
+// The exit status is 0 only if the download succeeded and the output matches the image.
+//   -q  do not print the log of MtkLogger
+//   -r  run at the speed of the emulated link (real time)
+//   -l  latency of the first reply to a command (msec, default 100)
+//   -b  bandwidth of the link (bytes/sec, default 20000, 0: unlimited)
+//   -p  rate of the lost data replies
+//   -o  rate of the swapped data replies (reordered)
+//   -t  rate of the truncated data replies
+//   -s  random seed of the impairments
+//   -f  flash size in Mbit (8, 16 or 32, default 8)
+//   -m  record mode (1: overwrite, 2: stop when full, default 1)
+
+#include <unistd.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include "host.h"
+
+#define SIZE_REPLY_BLOCK 0x800
+#define SIZE_CHUNK 256  // the size of the characters delivered at once
+
+typedef struct _simconfig {
+  uint32_t latency;    // latency of the first reply (msec)
+  uint32_t bandwidth;  // bytes per second (0: unlimited)
+  double loss;         // rate of the lost data replies
+  double reorder;      // rate of the swapped data replies
+  double truncate;     // rate of the truncated data replies
+  uint32_t eraseTime;  // time to erase the flash (msec)
+  int32_t flashSize;
+  const char *modelId;
+  int32_t recordMode;
+} simconfig_t;
+
+typedef struct _simstats {
+  uint32_t replies;
+  uint32_t lost;
+  uint32_t reordered;
+  uint32_t truncated;
+  uint32_t unknown;
+} simstats_t;
+
+MtkLogger logger("sim");  // static like the app's instance
+
+static simconfig_t config = {100, 20000, 0.0, 0.0, 0.0, 2000, 0x100000, "1388", 1};
+static simstats_t stats;
+static std::mt19937 rng;
+static std::vector<uint8_t> flash;
+static int32_t dataSize = 0;                // the size of the image
+static std::map<int32_t, int32_t> settings;  // 2: format, 3: time, 4: distance, 5: speed, 6: record mode
+static uint64_t linkReady = 0;               // the time the link finishes sending the queued replies (usec)
+
+static bool chance(double rate) {
+  return (rate > 0) && (std::uniform_real_distribution<double>(0.0, 1.0)(rng) < rate);
+}
+
+/**
+ * @fn void send(const std::vector<std::string> &replies, bool data)
+ * @brief Send the replies of a command. The first reply comes after the latency, and the characters are paced by
+ * the bandwidth. The data replies are impaired by the configured rates.
+ * @param replies The replies with CR/LF.
+ * @param data Set true if the replies are the data replies of a read request (the ACK included).
+ */
+static void send(std::vector<std::string> replies, bool data) {
+  uint64_t at = (uint64_t)(millis() + config.latency) * 1000;
+  if (at < linkReady) at = linkReady;
+
+  if (data) {
+    for (size_t i = 0; (i + 1) < replies.size(); i++) {
+      if (!chance(config.reorder)) continue;
+      std::swap(replies[i], replies[i + 1]);
+      stats.reordered++;
+    }
+  }
+
+  for (size_t i = 0; i < replies.size(); i++) {
+    std::string reply = replies[i];
+    if ((data) && (reply.compare(0, 11, "$PMTK182,8,") == 0)) {
+      if (chance(config.loss)) {
+        stats.lost++;
+        continue;
+      }
+      if (chance(config.truncate)) {
+        reply.resize(std::uniform_int_distribution<size_t>(12, reply.size() - 5)(rng));
+        stats.truncated++;
+      }
+    }
+    stats.replies++;
+
+    // deliver each chunk when its last character arrives
+    for (size_t pos = 0; pos < reply.size(); pos += SIZE_CHUNK) {
+      std::string chunk = reply.substr(pos, SIZE_CHUNK);
+      if (config.bandwidth > 0) at += ((uint64_t)chunk.size() * 1000000) / config.bandwidth;
+      hostDeliver((uint32_t)(at / 1000), chunk);
+    }
+  }
+  linkReady = at;
+}
+
+static void sendOne(const char *body) {
+  send(std::vector<std::string>(1, hostSentence(body)), false);
+}
+
+/**
+ * @fn int32_t lastAddress()
+ * @brief Get the address next to the last record (the log data ends with 0xFF).
+ */
+static int32_t lastAddress() {
+  int32_t end = dataSize;
+  while ((end > 0) && (flash[end - 1] == 0xFF)) end--;
+  return end;
+}
+
+/**
+ * @fn void readLogData(int32_t addr, int32_t size)
+ * @brief Answer a read request by the data replies of the blocks in the range and the ACK.
+ */
+static void readLogData(int32_t addr, int32_t size) {
+  std::vector<std::string> replies;
+  char body[16 + (SIZE_REPLY_BLOCK * 2)];
+
+  for (int32_t pos = addr; pos < (addr + size); pos += SIZE_REPLY_BLOCK) {
+    int32_t len = ((pos + SIZE_REPLY_BLOCK) < (addr + size)) ? SIZE_REPLY_BLOCK : ((addr + size) - pos);
+    int n = sprintf(body, "PMTK182,8,%08X,", pos);
+    for (int32_t i = 0; i < len; i++) {
+      uint8_t c = ((pos + i) < config.flashSize) ? flash[pos + i] : 0xFF;
+      n += sprintf(body + n, "%02X", c);
+    }
+    replies.push_back(hostSentence(body));
+  }
+  replies.push_back(hostSentence("PMTK001,182,7,3"));
+
+  send(replies, true);
+}
+
+/**
+ * @fn void hostCommand(const char *line)
+ * @brief Called by the BluetoothSerial shim for each command sent by MtkLogger. Answer it as the logger does.
+ */
+void hostCommand(const char *line) {
+  std::string body(line + ((line[0] == '$') ? 1 : 0));
+  body = body.substr(0, body.find('*'));
+
+  char reply[96];
+  int32_t n, addr, size;
+  if (sscanf(body.c_str(), "PMTK182,7,%x,%x", &addr, &size) == 2) {
+    readLogData(addr, size);
+  } else if (sscanf(body.c_str(), "PMTK182,2,%d", &n) == 1) {
+    if (n == 8) {
+      sprintf(reply, "PMTK182,3,8,%08X", lastAddress());
+    } else if (n == 2) {
+      sprintf(reply, "PMTK182,3,2,%08X", settings[2]);
+    } else if (settings.find(n) != settings.end()) {
+      sprintf(reply, "PMTK182,3,%d,%d", n, settings[n]);
+    } else {
+      sendOne("PMTK001,182,2,1");
+      return;
+    }
+    send({hostSentence(reply), hostSentence("PMTK001,182,2,3")}, false);
+  } else if (sscanf(body.c_str(), "PMTK182,1,%d,", &n) == 1) {
+    const char *arg = strchr(body.c_str() + 10, ',') + 1;
+    settings[n] = (n == 2) ? (int32_t)strtoul(arg, NULL, 16) : atoi(arg);
+    sendOne("PMTK001,182,1,3");
+  } else if (body.compare(0, 10, "PMTK182,6,") == 0) {
+    std::fill(flash.begin(), flash.end(), 0xFF);
+    dataSize = 0;
+    uint64_t erasedAt = (uint64_t)(millis() + config.eraseTime) * 1000;
+    if (linkReady < erasedAt) linkReady = erasedAt;
+    sendOne("PMTK001,182,6,3");
+  } else if (body == "PMTK605") {
+    sprintf(reply, "PMTK705,AXN_1.0-B_1.3_C01,%s,SIMULATOR,1.0", config.modelId);
+    send({hostSentence(reply), hostSentence("PMTK001,605,3")}, false);
+  } else if (body.compare(0, 7, "PMTK335") == 0) {
+    sendOne("PMTK001,335,3");
+  } else if (body == "PMTK101") {
+    sendOne("PMTK010,001");
+  } else if (body == "PMTK000") {
+    sendOne("PMTK001,0,3");
+  } else {
+    Serial.printf("Sim: unknown command %s\n", body.c_str());
+    stats.unknown++;
+    sprintf(reply, "PMTK001,%.16s,1", body.c_str() + 4);
+    sendOne(reply);
+  }
+}
+
+/**
+ * @fn bool loadImage(const char *path)
+ * @brief Read the log data image into the emulated flash. The rest of the flash is erased (0xFF).
+ */
+static bool loadImage(const char *path) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) return false;
+
+  flash.assign(config.flashSize, 0xFF);
+  dataSize = fread(flash.data(), 1, flash.size(), fp);
+  fclose(fp);
+
+  settings[2] = 0x0002003F;
+  settings[3] = 50;
+  settings[4] = 0;
+  settings[5] = 0;
+  settings[6] = config.recordMode;
+  return true;
+}
+
+/**
+ * @fn bool compareOutput(const char *path)
+ * @brief Compare the downloaded file with the flash. The file must hold all log data of the image, and may end with
+ * the erased part of the flash (0xFF).
+ */
+static bool compareOutput(const char *path) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) return false;
+
+  std::vector<uint8_t> output(config.flashSize + 1);
+  int32_t outputSize = fread(output.data(), 1, output.size(), fp);
+  fclose(fp);
+
+  if ((outputSize < lastAddress()) || (outputSize > config.flashSize)) {
+    fprintf(stderr, "sim: the output is %d bytes (the log data is %d bytes)\n", outputSize, lastAddress());
+    return false;
+  }
+  for (int32_t i = 0; i < outputSize; i++) {
+    if (output[i] == flash[i]) continue;
+    fprintf(stderr, "sim: the output differs at 0x%06X (%02X, expected %02X)\n", i, output[i], flash[i]);
+    return false;
+  }
+
+  return true;
+}
+
+int main(int argc, char **argv) {
+  static const struct {
+    const char *mbit;
+    int32_t size;
+    const char *modelId;
+  } FLASH_MODELS[] = {{"8", 0x100000, "1388"}, {"16", 0x200000, "001B"}, {"32", 0x400000, "0004"}};
+
+  bool realTime = false;
+  uint32_t seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "qrl:b:p:o:t:s:f:m:")) != -1) {
+    switch (opt) {
+    case 'q':
+      Serial.quiet = true;
+      break;
+    case 'r':
+      realTime = true;
+      break;
+    case 'l':
+      config.latency = atoi(optarg);
+      break;
+    case 'b':
+      config.bandwidth = atoi(optarg);
+      break;
+    case 'p':
+      config.loss = atof(optarg);
+      break;
+    case 'o':
+      config.reorder = atof(optarg);
+      break;
+    case 't':
+      config.truncate = atof(optarg);
+      break;
+    case 's':
+      seed = atoi(optarg);
+      break;
+    case 'f':
+      for (size_t i = 0; i < (sizeof(FLASH_MODELS) / sizeof(FLASH_MODELS[0])); i++) {
+        if (strcmp(optarg, FLASH_MODELS[i].mbit) != 0) continue;
+        config.flashSize = FLASH_MODELS[i].size;
+        config.modelId = FLASH_MODELS[i].modelId;
+      }
+      break;
+    case 'm':
+      config.recordMode = atoi(optarg);
+      break;
+    default:
+      optind = argc;  // show the usage
+      break;
+    }
+  }
+  if ((argc - optind) < 2) {
+    fprintf(stderr,
+            "usage: %s image.bin output.bin [-q] [-r] [-l latency] [-b bandwidth] [-p loss] [-o reorder] "
+            "[-t truncate] [-s seed] [-f 8|16|32] [-m 1|2]\n",
+            argv[0]);
+    return 2;
+  }
+  rng.seed(seed);
+  hostStart(realTime);
+
+  if (!loadImage(argv[optind])) {
+    fprintf(stderr, "sim: cannot read %s\n", argv[optind]);
+    return 1;
+  }
+
+  File32 output;
+  if (!output.open(argv[optind + 1], "w+b")) {
+    fprintf(stderr, "sim: cannot open %s\n", argv[optind + 1]);
+    return 1;
+  }
+
+  uint8_t addr[6] = {0, 0, 0, 0, 0, 0};
+  logger.connect(addr);
+  bool result = logger.downloadLogData(&output, NULL, NULL);
+  output.close();
+
+  bool match = (result) && (compareOutput(argv[optind + 1]));
+
+  dlstats_t st = logger.getDownloadStats();
+  fprintf(stderr,
+          "sim: %s [bytes=%u, time=%u, rate=%u, reqs=%u, timeouts=%u, resent=%u, outOfOrder=%u, dropped=%u, "
+          "broken=%u, replies=%u, lost=%u, reordered=%u, truncated=%u, unknown=%u]\n",
+          (match) ? "match" : ((result) ? "mismatch" : "failed"), st.bytes, st.elapsed, st.rateAvg, st.requests,
+          st.timeouts, st.resent, st.outOfOrder, st.dropped, st.broken, stats.replies, stats.lost, stats.reordered,
+          stats.truncated, stats.unknown);
+
+  return (match) ? 0 : 1;
+}